@@ -83,6 +83,11 @@ public:
 		return CacheVector;
 	}
 
+	/// The size of the vector when each open scope was pushed.
+	const std::vector<size_t>& getCacheStack() const {
+		return CacheStack;
+	}
+
 	/// This function only gets the elements you have
 	/// not got using this function.
 	///
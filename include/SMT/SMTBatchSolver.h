@@ -0,0 +1,77 @@
+/**
+ * A thread pool for solving independent queries in batches.
+ */
+
+#ifndef SMT_SMTBATCHSOLVER_H
+#define SMT_SMTBATCHSOLVER_H
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include "SMTSolver.h"
+
+class SMTExprVec;
+
+/// A fixed pool of worker threads, each of which owns a thread-local
+/// SMTFactory. Queries are translated into the factory of the worker that
+/// solves them, so workers never share a z3::context.
+///
+/// Each worker has its own task queue. A batch is split into contiguous
+/// chunks over the queues, and an idle worker steals tasks from the
+/// others, so that a few hard queries do not keep the other workers idle.
+///
+/// The number of workers is set by -solver-batch-threads, which defaults
+/// to the number of hardware threads.
+class SMTBatchSolver {
+public:
+	static SMTBatchSolver& get();
+
+	/// Solve each of \p Queries (a conjunction each) independently. The
+	/// results are in the order of \p Queries. It blocks until all queries
+	/// are solved, and can be called by several threads at the same time.
+	///
+	/// The factories of \p Queries are locked (see SMTFactory::getFactoryLock)
+	/// while their exprs are translated, so the calling thread must not
+	/// hold these locks.
+	std::vector<SMTSolver::SMTResultType> solve(const std::vector<SMTExprVec>& Queries);
+
+	unsigned getNumWorkers() const {
+		return NumWorkers;
+	}
+
+private:
+	struct Batch;
+
+	struct Task {
+		Batch* Owner;
+		size_t Index;
+	};
+
+	struct WorkQueue {
+		std::mutex QueueLock;
+		std::deque<Task> Tasks;
+	};
+
+	unsigned NumWorkers;
+
+	std::vector<std::unique_ptr<WorkQueue>> Queues;
+
+	std::vector<std::thread> Workers;
+
+	/// for idle workers waiting for tasks
+	std::mutex IdleLock;
+	std::condition_variable IdleCond;
+	size_t PendingTasks = 0;
+
+	explicit SMTBatchSolver(unsigned NumWorkers);
+
+	void work(unsigned WorkerId);
+
+	bool popTask(unsigned WorkerId, Task& T);
+};
+
+#endif
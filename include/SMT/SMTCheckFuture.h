@@ -0,0 +1,103 @@
+/**
+ * A handle of an asynchronous SMTSolver::check().
+ */
+
+#ifndef SMT_SMTCHECKFUTURE_H
+#define SMT_SMTCHECKFUTURE_H
+
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "SMTSolver.h"
+
+/// It is returned by SMTSolver::checkAsync(), which solves the assertions
+/// of the solver in a background thread. Copies of a handle refer to the
+/// same check.
+///
+/// Thread-safety rules:
+///   - The background thread holds the FactoryLock of the solver's factory
+///     while solving. Other threads using the factory (or exprs, models
+///     and solvers created by it) must hold the lock too, or wait until
+///     the check completes. In particular, do not hold the lock while
+///     waiting for the check, which would never complete.
+///   - The solver (and all its copies, which share the underlying z3
+///     solver) must not be used, and the solver and its factory must not be
+///     destroyed, until the check completes. Use wait() or cancel() first.
+///   - The handle itself can be used by any thread.
+class SMTCheckFuture {
+public:
+	typedef std::function<void(SMTSolver::SMTResultType)> CallbackTy;
+
+	SMTCheckFuture() {
+	}
+
+	bool valid() const {
+		return State != nullptr;
+	}
+
+	/// If the check has completed.
+	bool ready() const;
+
+	/// Block until the check completes.
+	void wait() const;
+
+	template<class Rep, class Period>
+	std::future_status wait_for(const std::chrono::duration<Rep, Period>& Timeout) const {
+		std::unique_lock<std::mutex> L(State->StateLock);
+		bool Done = State->Cond.wait_for(L, Timeout, [this]() { return State->Done; });
+		return Done ? std::future_status::ready : std::future_status::timeout;
+	}
+
+	/// Block until the check completes, and return its result.
+	SMTSolver::SMTResultType get() const;
+
+	/// Stop the check, and block until it stops. The result is unknown
+	/// unless the check has completed. A check that has not started (i.e.
+	/// whose thread is waiting for the FactoryLock) is skipped. A started
+	/// check is stopped by Z3_interrupt, which also stops the members of
+	/// -solver-portfolio solving it. Only checks solved by z3 can be
+	/// interrupted; other backends (e.g. external SMTLIB solvers and smtd)
+	/// stop at their timeouts.
+	///
+	/// It must not be called while holding the FactoryLock: a check that
+	/// has not started waits for the lock before it can be skipped.
+	void cancel();
+
+	/// If the check has been cancelled.
+	bool cancelled() const;
+
+	/// Call \p Callback with the result when the check completes. It is
+	/// called in the background thread after the FactoryLock is released,
+	/// or immediately in the calling thread if the check has completed.
+	void then(CallbackTy Callback);
+
+private:
+	struct SharedState {
+		std::mutex StateLock;
+		std::condition_variable Cond;
+		bool Done = false;
+		bool Cancelled = false;
+		/// If the background thread has started solving
+		bool Started = false;
+		/// If the background thread has stopped using the context, i.e.
+		/// is about to release the FactoryLock
+		bool Finished = false;
+		SMTSolver::SMTResultType Result = SMTSolver::SMTRT_Unknown;
+		std::vector<CallbackTy> Callbacks;
+		Z3_context Ctx = nullptr;
+	};
+
+	std::shared_ptr<SharedState> State;
+
+	/// Run \p Solver.check() in a background thread.
+	static SMTCheckFuture launch(SMTSolver* Solver, Z3_context Ctx);
+
+	friend class SMTSolver;
+};
+
+#endif
@@ -11,6 +11,13 @@
 class SMTConfig {
 public:
 
+    // How to start an SMTLIB solver
+    struct SMTLIBSolverSpec {
+        std::string Name;
+        std::string Path;
+        std::vector<std::string> Args;
+    };
+
     // static int Timeout;
     static std::string Tactic;
 
@@ -19,10 +26,23 @@ public:
     static bool UseIncrementalSMTLIBSolver;
     static std::string SMTLIBSolverPath;
     static std::vector<std::string> SMTLIBSolverArgs;
+    // The deadline (ms) of a query enforced by killing the solver, 0 if none
+    static unsigned SMTLIBSolverTimeout;
+    // The solvers racing on each non-incremental query (-smtlib-portfolio)
+    static std::vector<SMTLIBSolverSpec> SMTLIBPortfolio;
+    // The logic declared to SMTLIB solvers, or "auto" for the
+    // smallest logic of each query (see SMTFragment::getLogic)
+    static std::string SMTLIBLogic;
+    // The logic declared by "auto" if no standard logic fits a query
+    static std::string SMTLIBFallbackLogic;
     // End
 
 public:
     static void init();
+
+    // The spec of the solver named z3, cvc5, btor or yices2 (or z3 for
+    // an unknown name) in the incremental mode or not
+    static SMTLIBSolverSpec getSMTLIBSolverSpec(const std::string& Name, bool Incremental);
 };
 
 
@@ -0,0 +1,129 @@
+/**
+ * A budgeted engine of the contextual simplification by Dillig et al.
+ */
+
+#ifndef SMT_SMTDILLIGSIMPLIFIER_H
+#define SMT_SMTDILLIGSIMPLIFIER_H
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "z3++.h"
+
+/// It simplifies each leaf (a non AND/OR subformula) of a formula to true
+/// or false if the leaf is implied, or its negation is implied, by the
+/// critical constraint of the leaf, i.e. the conjunction of its siblings
+/// (negated under OR) along the path from the root. Sweeps over the
+/// children of a connective are repeated until nothing changes.
+///
+/// The engine is bounded by a budget of time (-dillig-time-budget) and
+/// solver calls (-dillig-call-budget). When the budget runs out, leaves
+/// are no longer checked and the partially simplified formula, which is
+/// still equivalent to the input, is returned. Each solver call is bounded
+/// by the time left in the budget.
+///
+/// The budget and the memo belong to the engine, so the formulas
+/// simplified by one engine share them, e.g. the new assertions of a check
+/// with -solver-simplify=dillig.
+///
+/// Leaf verdicts are memoized by the AST ids of the leaf and the critical
+/// constraint. With -dillig-threads > 1, the children of the root are
+/// simplified speculatively in parallel, each thread on its own translated
+/// context. The speculative result of a child is committed only if no
+/// earlier child has changed in the same sweep, since otherwise its
+/// critical constraint is stale, and the child is simplified again.
+class SMTDilligSimplifier {
+public:
+	struct Statistics {
+		uint64_t SolverCalls = 0;
+		uint64_t MemoHits = 0;
+		uint64_t Speculations = 0;
+		uint64_t CommittedSpeculations = 0;
+		bool Exhausted = false;
+	};
+
+	explicit SMTDilligSimplifier(z3::context& Ctx);
+
+	z3::expr simplify(const z3::expr& E);
+
+	const Statistics& getStatistics() const {
+		return Stats;
+	}
+
+private:
+	/// Shared by the engines of the threads of a speculation.
+	struct Budget {
+		bool HasDeadline = false;
+		std::chrono::steady_clock::time_point Deadline;
+		uint64_t MaxCalls = 0;
+		std::atomic<uint64_t> Calls;
+		std::atomic<bool> Exhausted;
+
+		Budget() : Calls(0), Exhausted(false) {
+		}
+
+		/// Returns false if a solver call is not affordable.
+		bool consume();
+
+		/// The time left before the deadline, in ms, at least 1
+		unsigned remainingMs() const;
+	};
+
+	enum Verdict {
+		V_False, V_True, V_Unchanged
+	};
+
+	struct MemoKey {
+		unsigned LeafId;
+		uint64_t ContextHash;
+
+		bool operator==(const MemoKey& K) const {
+			return LeafId == K.LeafId && ContextHash == K.ContextHash;
+		}
+	};
+
+	struct MemoKeyHash {
+		size_t operator()(const MemoKey& K) const {
+			return std::hash<uint64_t>()(K.ContextHash * 31 + K.LeafId);
+		}
+	};
+
+	z3::context& Ctx;
+
+	z3::solver Solver4Sim;
+
+	Budget OwnBudget;
+
+	Budget& B;
+
+	/// The exprs whose ids are used in memo keys, kept alive
+	/// so that the ids are not reused.
+	std::vector<z3::expr> Pinned;
+
+	std::unordered_map<MemoKey, Verdict, MemoKeyHash> Memo;
+
+	Statistics Stats;
+
+	/// an engine of a speculation thread
+	SMTDilligSimplifier(z3::context& Ctx, Budget& B);
+
+	z3::expr simplify(const z3::expr& N, uint64_t ContextHash, bool Speculate);
+
+	z3::expr simplifyLeaf(const z3::expr& N, uint64_t ContextHash);
+
+	/// Check \p N under the critical constraints in Solver4Sim.
+	z3::check_result checkLeaf(const z3::expr& N);
+
+	/// The critical constraint of the \p I-th child of a connective.
+	z3::expr criticalConstraint(const std::vector<z3::expr>& C, size_t I, bool IsOr);
+
+	uint64_t extendContext(uint64_t ContextHash, const z3::expr& Alpha);
+
+	/// Simplify each of \p C under its critical constraint in parallel.
+	std::vector<z3::expr> speculate(const std::vector<z3::expr>& C, uint64_t ContextHash, bool IsOr);
+};
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * A background writer dumping slow queries to files.
+ */
+
+#ifndef SMT_SMTDUMPWRITER_H
+#define SMT_SMTDUMPWRITER_H
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <unordered_set>
+#include <condition_variable>
+
+#include "SMTSolver.h"
+#include "SMTFingerprint.h"
+
+/// It writes the queries whose solving time exceeds -dump-cnts-timeout to
+/// the directory -dump-cnts-dst, without blocking the solving threads on
+/// file I/O. A query is serialized by the calling thread (which owns its
+/// z3::context) and written by a background thread.
+///
+/// A query is written to <dst>/<fingerprint>.smt2, with its timing and
+/// result as comments at the beginning, so the same query (from any run)
+/// is written at most once. The dumps are also capped by rate
+/// (-dump-cnts-rate), total size (-dump-cnts-max-mb) and the number of
+/// queued queries (-dump-cnts-queue); queries beyond the caps are dropped.
+class SMTDumpWriter {
+public:
+	struct Statistics {
+		uint64_t Written = 0;
+		uint64_t Duplicates = 0;
+		uint64_t RateLimited = 0;
+		uint64_t DiskLimited = 0;
+		uint64_t QueueFull = 0;
+		uint64_t Failed = 0;
+	};
+
+	/// Returns nullptr if -dump-cnts-dst is not set.
+	static SMTDumpWriter* get();
+
+	/// Check the fingerprint and the caps before serializing a query.
+	/// If it returns true, the query must be passed to submit().
+	bool claim(const SMTFingerprint& Key);
+
+	/// Queue a claimed query (in SMT-LIB format) for writing.
+	void submit(const SMTFingerprint& Key, std::string Query, uint64_t SolveTimeUs, unsigned TimeoutMs,
+			SMTSolver::SMTResultType Result);
+
+	/// Block until the queued queries are written.
+	void flush();
+
+	Statistics getStatistics();
+
+private:
+	struct Job {
+		SMTFingerprint Key;
+		std::string Query;
+		uint64_t SolveTimeUs;
+		unsigned TimeoutMs;
+		SMTSolver::SMTResultType Result;
+	};
+
+	std::string Dst;
+
+	std::mutex WriterLock;
+	std::condition_variable QueueCond;
+	std::condition_variable IdleCond;
+
+	std::deque<Job> Queue;
+	bool Writing = false;
+
+	/// fingerprints claimed by this process
+	std::unordered_set<std::string> Claimed;
+
+	/// bytes in the destination, including the queued queries
+	uint64_t DiskUsage = 0;
+
+	/// the claims in the last minute
+	std::deque<std::chrono::steady_clock::time_point> RecentClaims;
+
+	Statistics Stats;
+
+	explicit SMTDumpWriter(const std::string& Dst);
+
+	std::string pathOf(const SMTFingerprint& Key) const;
+
+	void work();
+
+	void write(const Job& J);
+};
+
+#endif
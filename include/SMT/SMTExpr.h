@@ -308,10 +308,7 @@ public:
 	friend class SMTSolver;
 	friend class SMTExprVec;
 	friend class SMTExprComparator;
-
-private:
-	SMTExpr dilligSimplify(SMTExpr N, z3::solver& Solver4Sim, z3::context& Ctx);
-
+	friend class SMTModel;
 };
 
 // This can be used as the comparator of a stl container,
@@ -374,6 +371,7 @@ public:
 	friend class SMTFactory;
 	friend class SMTSolver;
 	friend class SMTExpr;
+	friend class SMTModel;
 
 	friend llvm::raw_ostream & operator<<(llvm::raw_ostream& Out, SMTExprVec Vec);
 	friend std::ostream & operator<<(std::ostream& Out, SMTExprVec Vec);
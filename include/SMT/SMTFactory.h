@@ -7,6 +7,7 @@
 
 #include <string>
 #include <mutex>
+#include <atomic>
 #include <vector>
 #include <unordered_map>
 #include <map>
@@ -14,6 +15,11 @@
 #include "z3++.h"
 #include "SMTExpr.h"
 #include "SMTSolver.h"
+#include "SMTQueryCache.h"
+#include "SMTUnsatCoreCache.h"
+#include "SMTModelPool.h"
+#include "SMTTelemetry.h"
+#include "SMTFragment.h"
 
 class SmtlibSmtSolver;
 
@@ -51,6 +57,32 @@ private:
 
 	unsigned TempSMTVaraibleIndex;
 
+	/// The caches below are used by check() without locking, so the
+	/// threads sharing this factory must hold the FactoryLock while
+	/// checking. CachesInUse is set while a check uses them, to assert it.
+	std::atomic<bool> CachesInUse;
+
+	/// Results of the queries solved by the solvers of this factory.
+	/// It must be declared after Ctx since it pins exprs of Ctx.
+	SMTQueryCache QueryCache;
+
+	/// Unsat cores of the queries solved by the solvers of this factory.
+	SMTUnsatCoreCache UnsatCoreCache;
+
+	/// Recent models found by the solvers of this factory.
+	SMTModelPool ModelPool;
+
+	/// Results of the independent components of sliced queries.
+	SMTQueryCache ComponentCache;
+
+	/// Telemetry of the queries solved by the solvers of this factory.
+	SMTTelemetry Telemetry;
+
+	std::string TelemetryTag;
+
+	/// The queries solved by the solvers of this factory, per fragment.
+	SMTFragmentStatistics FragmentStatistics;
+
 public:
         // { Begin of SMTLIB solver related staff
 	bool useSMTLIBSolver = false;
@@ -125,14 +157,65 @@ public:
 	/// constraint, and the second indicates if some variables are pruned.
 	std::pair<SMTExprVec, bool> rename(const SMTExprVec&, const std::string&, std::unordered_map<std::string, SMTExpr>&, SMTRenamingAdvisor* = nullptr);
 
+	/// Check each query (a conjunction of the exprs in a SMTExprVec, which may
+	/// be created by any factory) independently on a pool of worker threads.
+	/// Each worker solves the queries with its own thread-local factory, to
+	/// which the queries are translated. The results are in input order.
+	///
+	/// The factories of the queries are locked during translation, so do not
+	/// hold their FactoryLock when calling it. See SMTBatchSolver for details.
+	static std::vector<SMTSolver::SMTResultType> checkBatch(const std::vector<SMTExprVec>& Queries);
+
 	std::mutex& getFactoryLock() {
 		return FactoryLock;
 	}
 
+	/// The query cache is enabled by -solver-query-cache=<entries>.
+	SMTQueryCache& getQueryCache() {
+		return QueryCache;
+	}
+
+	/// The unsat core cache is enabled by -solver-unsat-core-cache=<cores>.
+	SMTUnsatCoreCache& getUnsatCoreCache() {
+		return UnsatCoreCache;
+	}
+
+	/// The model pool is enabled by -solver-model-reuse=<models>.
+	SMTModelPool& getModelPool() {
+		return ModelPool;
+	}
+
+	/// It is used when -solver-independence-slicing is enabled.
+	SMTQueryCache& getComponentCache() {
+		return ComponentCache;
+	}
+
+	/// It records the queries when -solver-telemetry is enabled.
+	SMTTelemetry& getTelemetry() {
+		return Telemetry;
+	}
+
+	/// The queries solved by the backends, per fragment (e.g. bv or int).
+	SMTFragmentStatistics& getFragmentStatistics() {
+		return FragmentStatistics;
+	}
+
+	/// The queries solved afterwards are recorded under \p Tag, e.g.
+	/// the name of the analysis issuing them.
+	void setTelemetryTag(const std::string& Tag) {
+		TelemetryTag = Tag;
+	}
+
+	const std::string& getTelemetryTag() const {
+		return TelemetryTag;
+	}
+
 	SMTExpr parseSMTLib2String(const std::string&);
 
 	SMTExpr parseSMTLib2File(const std::string&);
 
+	friend class SMTSolver;
+
 private:
 	typedef struct RenamingUtility {
 		bool WillBePruned;
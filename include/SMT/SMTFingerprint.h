@@ -0,0 +1,45 @@
+/**
+ * Stable structural fingerprints of queries.
+ */
+
+#ifndef SMT_SMTFINGERPRINT_H
+#define SMT_SMTFINGERPRINT_H
+
+#include <string>
+#include <cstdint>
+
+#include "z3++.h"
+
+/// A 128-bit fingerprint of a set of assertions.
+///
+/// Different from AST ids and Z3's own hash values, it only depends on the
+/// structure of the formulas (symbol names, sorts, numerals and operators).
+/// Thus, it is stable across z3::context instances, processes and runs,
+/// and can be used to identify a query outside of the current process.
+/// As a set fingerprint, the order and the duplication of the assertions
+/// do not matter.
+struct SMTFingerprint {
+	uint64_t Hi = 0;
+	uint64_t Lo = 0;
+
+	bool operator==(const SMTFingerprint& F) const {
+		return Hi == F.Hi && Lo == F.Lo;
+	}
+
+	bool operator!=(const SMTFingerprint& F) const {
+		return !(*this == F);
+	}
+
+	bool empty() const {
+		return Hi == 0 && Lo == 0;
+	}
+
+	/// 32 hex digits, e.g. for naming files
+	std::string str() const;
+
+	static SMTFingerprint of(const z3::expr_vector& Assertions);
+
+	static SMTFingerprint of(const z3::expr& Expr);
+};
+
+#endif
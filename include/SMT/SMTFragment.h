@@ -0,0 +1,156 @@
+/**
+ * Classification of queries into SMT-LIB fragments (logics).
+ */
+
+#ifndef SMT_SMTFRAGMENT_H
+#define SMT_SMTFRAGMENT_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <llvm/Support/raw_ostream.h>
+
+#include "z3++.h"
+#include "SMTSolver.h"
+
+/// The theories used by a query, as a set of features. A query without
+/// any feature is pure Boolean.
+class SMTFragment {
+public:
+	enum Feature {
+		BV = 1 << 0,
+		Array = 1 << 1,
+		/// uninterpreted functions of a positive arity, or uninterpreted sorts
+		UF = 1 << 2,
+		Int = 1 << 3,
+		Real = 1 << 4,
+		/// a product of variables, or a division by a variable
+		NonLinear = 1 << 5,
+		Quantifier = 1 << 6,
+		/// e.g. floating points, strings and datatypes
+		Other = 1 << 7
+	};
+
+	SMTFragment(unsigned Features = 0) : Features(Features) {
+	}
+
+	unsigned getFeatures() const {
+		return Features;
+	}
+
+	bool has(Feature F) const {
+		return Features & F;
+	}
+
+	/// The features joined by '+', e.g. bv+array, or bool if there is none.
+	std::string getName() const;
+
+	/// The smallest standard SMT-LIB logic containing the fragment, e.g.
+	/// QF_BV or QF_AUFLIA, or ALL if there is none (e.g. for int2bv), in
+	/// which case -smtlib-logic=auto declares -smtlib-fallback-logic.
+	///
+	/// A pure Boolean query is declared as QF_BV, since QF_UF is not
+	/// accepted by some bit-vector solvers (e.g. boolector).
+	std::string getLogic() const;
+
+	/// The logic of the z3 solver specialized for the fragment (see
+	/// Z3_mk_solver_for_logic), or "" if the incremental solver is as
+	/// good, which is the case except for nonlinear arithmetic.
+	std::string getZ3Logic() const;
+
+	bool operator==(const SMTFragment& F) const {
+		return Features == F.Features;
+	}
+
+	bool operator!=(const SMTFragment& F) const {
+		return Features != F.Features;
+	}
+
+private:
+	unsigned Features;
+};
+
+/// It computes the fragment of the assertions of a solver as they are
+/// added, scoped by push()/pop(). Each new node of an assertion is
+/// visited once: the features of the visited nodes are memoized by their
+/// AST ids, so the subterms shared by the assertions are not visited
+/// again.
+class SMTFragmentClassifier {
+public:
+	void add(const z3::expr& E);
+
+	void push();
+
+	void pop(unsigned N = 1);
+
+	void reset();
+
+	/// The fragment of the assertions in the open scopes.
+	SMTFragment current() const {
+		return Current;
+	}
+
+	/// The fragment of \p E, without memoization.
+	static SMTFragment of(const z3::expr& E);
+
+private:
+	unsigned Current = 0;
+
+	/// Current when each open scope is pushed
+	std::vector<unsigned> Scopes;
+
+	/// AST id -> <node, the features of the node and its subterms>.
+	/// The node is kept alive, so that its id is not reused.
+	std::unordered_map<unsigned, std::pair<z3::expr, unsigned>> Memo;
+
+	/// sort id -> <sort, its features>
+	std::unordered_map<unsigned, std::pair<z3::sort, unsigned>> SortMemo;
+
+	unsigned classify(z3::context& Ctx, Z3_ast Root);
+
+	unsigned sortFeatures(z3::context& Ctx, Z3_sort Sort);
+
+	/// The features of the operator of \p Node, not including its sort
+	/// and arguments.
+	static unsigned operatorFeatures(z3::context& Ctx, Z3_ast Node);
+};
+
+/// The queries solved by the backends (i.e. not by the caches) of the
+/// solvers of a factory, per fragment. It is meant for checking
+/// the query mix and the benefit of -solver-route-by-logic.
+///
+/// It can be read by any thread.
+class SMTFragmentStatistics {
+public:
+	struct Entry {
+		/// see SMTFragment::getLogic()
+		std::string Logic;
+		uint64_t Queries = 0;
+		uint64_t Sat = 0;
+		uint64_t Unsat = 0;
+		uint64_t Unknown = 0;
+		/// total solving time, in microseconds
+		uint64_t TimeUs = 0;
+		/// queries solved by a z3 solver specialized for the logic
+		uint64_t Routed = 0;
+	};
+
+	void record(const SMTFragment& F, SMTSolver::SMTResultType Result, uint64_t TimeUs, bool Routed);
+
+	/// fragment name -> its queries
+	std::map<std::string, Entry> get();
+
+	void print(llvm::raw_ostream& O);
+
+	void clear();
+
+private:
+	std::mutex StatisticsLock;
+
+	std::map<std::string, Entry> Entries;
+};
+
+#endif
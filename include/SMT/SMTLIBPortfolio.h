@@ -0,0 +1,81 @@
+/**
+ * A portfolio of external SMTLIB solvers racing on each query.
+ */
+
+#ifndef SMT_SMTLIBPORTFOLIO_H
+#define SMT_SMTLIBPORTFOLIO_H
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <llvm/Support/raw_ostream.h>
+
+#include "SMTLIBSolver.h"
+#include "SMTConfigure.h"
+
+/// It sends a whole query to one process of each solver of
+/// -smtlib-portfolio at the same time, and returns the first definitive
+/// (sat or unsat) answer. The other solvers are still solving, so they
+/// are restarted, which is cheaper than waiting for them; the ones that
+/// have answered are reset for the next query.
+///
+/// The calling thread waits for all of them by poll(), and each solver
+/// is bounded by -smtlib-solver-timeout like a single solver.
+///
+/// The statistics of the members (e.g. their win rates and times) are
+/// meant for choosing the solvers of the portfolio.
+class SMTLIBPortfolio {
+public:
+	struct MemberStatistics {
+		std::string Name;
+		/// queries in which the member has been run
+		uint64_t Runs = 0;
+		/// queries answered by the member first
+		uint64_t Wins = 0;
+		/// total time of the won queries, in microseconds
+		uint64_t WinTimeUs = 0;
+		/// queries answered by the member with unknown or an error,
+		/// or in which it has timed out or exited
+		uint64_t Failures = 0;
+		/// queries in which the member is restarted for losing the race
+		uint64_t Losses = 0;
+	};
+
+	/// Returns nullptr if no portfolio is configured.
+	static SMTLIBPortfolio* get();
+
+	/// Solve \p Query, which ends with (check-sat). If the result is not
+	/// definitive, \p ReasonUnknown is set to the reasons of the members.
+	///
+	/// It may be called concurrently.
+	SMTLIBSolverResult check(const std::string& Query, std::string& ReasonUnknown);
+
+	std::vector<MemberStatistics> getStatistics();
+
+	void printStatistics(llvm::raw_ostream& O);
+
+private:
+	/// One process for each member. A lane is used by one query at a time,
+	/// and is reused by later queries to avoid starting processes.
+	struct Lane {
+		std::vector<std::unique_ptr<SmtlibSmtSolver>> Solvers;
+	};
+
+	std::vector<SMTConfig::SMTLIBSolverSpec> Members;
+
+	std::mutex PortfolioLock;
+
+	std::vector<MemberStatistics> Stats;
+
+	std::vector<std::unique_ptr<Lane>> FreeLanes;
+
+	explicit SMTLIBPortfolio(const std::vector<SMTConfig::SMTLIBSolverSpec>& Specs);
+
+	std::unique_ptr<Lane> acquireLane();
+
+	void releaseLane(std::unique_ptr<Lane> L);
+};
+
+#endif
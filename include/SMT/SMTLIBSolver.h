@@ -6,12 +6,14 @@
 #define SMTLIBSOLVER_SMTLIB_SOLVER_H_
 
 
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
+#include <sys/uio.h>
 
 
 enum SMTLIBSolverResult {
@@ -35,10 +37,62 @@ public:
 
 	SMTLIBSolverResult solveWholeFormula(std::string query);
 
+	/// Send a query ending with (check-sat) like solveWholeFormula(),
+	/// without waiting for the answer, which is read by pollCheckSatResult().
+	void sendWholeFormula(const std::string& query);
+
+	/// Start a query, which is then written by writeData() (e.g. by an
+	/// SMTLIBWriter) and answered by readCheckSatResult().
+	void startQuery();
+
+	/// Write raw text to the solver, which is not necessarily a whole command.
+	void writeData(const char* data, size_t size);
+
+	/*!
+	 * Reads the responses up to the answer of a check-sat. If the solver
+	 * exits or misses the deadline, it is restarted and the result is
+	 * unknown, so that a hanging solver does not block the caller.
+	 */
+	SMTLIBSolverResult readCheckSatResult();
+
+	/// Read the available output without blocking. Returns true if the
+	/// answer of the query is read (or the solver has exited or missed
+	/// the deadline, as in solveWholeFormula()) into \p result.
+	bool pollCheckSatResult(SMTLIBSolverResult& result);
+
+	/// The descriptor to poll() for the output of the solver.
+	int getOutputFd() const {
+		return fromSolver;
+	}
+
+	/*!
+	 * Kills the solver process (if still running) and starts a new one
+	 * with the same logic, e.g. when it misses the deadline of a query.
+	 * @param reason recorded as the reason of the unknown result
+	 */
+	void restart(const std::string& reason);
+
 	void push(unsigned num = 1);
 	void pop(unsigned num = 1);
 	unsigned getContextLevel() const;
+
+	/// Returns false if the solver process has exited, in which case
+	/// the pipes are closed and processIdOfSolver is 0.
+	bool isRunning();
+
+	/// Why the last check returned unknown (or error), e.g. "timeout".
+	const std::string& getReasonUnknown() const {
+		return reasonUnknown;
+	}
+
+	/// The number of times the process has been restarted. The solver
+	/// loses its assertions and scopes when restarted, so a client
+	/// mirroring them has to send them again if this changes.
+	unsigned getGeneration() const {
+		return generation;
+	}
   
+        /// Clear the assertions, scopes and logic by (reset).
         void reset();
 
 	// path to the solver binary
@@ -55,19 +109,64 @@ protected:
 
 	void init();
 
-	void writeCommand(std::string smt2Command);
+	/// Starts the deadline (-smtlib-solver-timeout) of a query, which
+	/// ends at the end of readCheckSatResult().
+	void startDeadline();
+
+	/// The time to the deadline for poll(), or -1 if there is none.
+	int remainingTime() const;
+
+	bool hasDeadline = false;
+	std::chrono::steady_clock::time_point deadline;
 
 	/*!
-	 * Reads from the solver. The output is checked for an error message and an exception is thrown in that case.
-	 * @param waitForOutput if this is true and there is currently no output, we will wait until there is output.
-	 * @return the output of the solver. Every entry of the vector corresponds to one output line
+	 * Writes the command and a newline to the solver, retrying short writes.
+	 * While the pipe is full, the output of the solver is read into the
+	 * read buffer, so that neither side blocks the other.
 	 */
-         std::string readSolverOutput(bool waitForOutput = true);
+	void writeCommand(const std::string& smt2Command);
+
+	void writeParts(struct iovec* parts, int numParts);
+
+	/*!
+	 * Reads one response of the solver, i.e. a balanced s-expression or an
+	 * atom such as "sat", waiting until it is complete. The output is read
+	 * by poll() and large reads into a reusable buffer, so a large response
+	 * (e.g. of get-model) needs a few syscalls.
+	 * @param wait if false, only the available output is read
+	 * @return false if the solver has exited or the deadline has passed
+	 * (or, if not \p wait, no output is available) before a complete response
+	 */
+	bool readResponse(std::string& response, bool wait = true);
+
+	/// Returns true if \p response is the answer of a check-sat, which is
+	/// put in \p result. The other responses are kept in pendingOutput.
+	bool takeCheckSatResponse(const std::string& response, SMTLIBSolverResult& result);
+
+	/// Restarts the solver which has exited or missed the deadline.
+	SMTLIBSolverResult abandonQuery();
+
+	// the responses before the answer of a check-sat
+	std::string pendingOutput;
+
+	/// Reads the available output into readBuffer. Returns false on EOF.
+	bool fillReadBuffer();
+
+	/// Scans readBuffer from scanPos for the end of the response
+	/// beginning at readBegin.
+	bool scanResponse(size_t& end);
+
+	std::vector<char> readBuffer;
+	size_t readBegin = 0;
+	size_t readEnd = 0;
+	size_t scanPos = 0;
+	enum { SS_Start, SS_Atom, SS_List, SS_String, SS_QuotedSymbol, SS_Comment } scanState = SS_Start;
+	unsigned scanDepth = 0;
 
 	/*!
 	 * Checks if the given message contains an error message and throws an exception.
 	 * More precisely, an exception is thrown whenever the word "error" is contained in the message.
-	 * This function is directly called when reading the solver output via readSolverOutput()
+	 * This function is directly called when reading the solver output via readCheckSatResult()
 	 * We will try to parse the message in the SMT-LIBv2 format, i.e.,
 	 * ( error "this is the error message from the solver" ) to give some debug information
 	 * However, the whole message is always written to the debug log (providing there is an error)
@@ -87,6 +186,14 @@ public:
 	// (e.g., number of pushes - number of pops)
 	unsigned contextLevel;
 
+protected:
+	// the logic set by setLogic(), which is set again on restart
+	std::string logic;
+
+	std::string reasonUnknown;
+
+	unsigned generation = 0;
+
 };
 
 
@@ -0,0 +1,93 @@
+/**
+ * A pool of warm external SMTLIB solver processes.
+ */
+
+#ifndef SMT_SMTLIBSOLVERPOOL_H
+#define SMT_SMTLIBSOLVERPOOL_H
+
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+#include "SMTLIBSolver.h"
+
+/// It keeps up to -smtlib-pool-size (0 by default) idle solver processes,
+/// started when the pool is first used, so that a non-incremental query does
+/// not pay for starting a process. With 0, each query starts its own. A solver is checked out for a query and
+/// checked in afterwards, when it is cleared by (reset) for the next one.
+///
+/// A solver is not reused if its process has exited (e.g. crashed or
+/// timed out), or it has answered -smtlib-pool-max-queries queries, or
+/// its resident memory exceeds -smtlib-pool-max-rss-mb; a fresh process
+/// replaces it in the pool.
+///
+/// Checkout and checkin are thread-safe. If no solver is idle, checkout
+/// starts a new one instead of waiting, and the extra solvers are shut
+/// down at checkin once the pool is full.
+class SMTLIBSolverPool {
+public:
+	struct Statistics {
+		uint64_t Started = 0;
+		uint64_t Reused = 0;
+		uint64_t Recycled = 0;
+		uint64_t Dead = 0;
+	};
+
+	/// A solver checked out of the pool, which is checked in when
+	/// the lease is destroyed.
+	class Lease {
+	public:
+		Lease(Lease&& L) : Pool(L.Pool), Solver(L.Solver) {
+			L.Solver = nullptr;
+		}
+
+		~Lease();
+
+		SmtlibSmtSolver* operator->() const {
+			return Solver;
+		}
+
+		SmtlibSmtSolver* get() const {
+			return Solver;
+		}
+
+	private:
+		SMTLIBSolverPool* Pool;
+		SmtlibSmtSolver* Solver;
+
+		Lease(SMTLIBSolverPool* P, SmtlibSmtSolver* S) : Pool(P), Solver(S) {
+		}
+
+		Lease(const Lease&) = delete;
+		Lease& operator=(const Lease&) = delete;
+
+		friend class SMTLIBSolverPool;
+	};
+
+	/// The pool of the solver configured by SMTConfig.
+	static SMTLIBSolverPool& get();
+
+	Lease checkout();
+
+	Statistics getStatistics();
+
+	~SMTLIBSolverPool();
+
+private:
+	std::mutex PoolLock;
+
+	std::vector<SmtlibSmtSolver*> Idle;
+
+	Statistics Stats;
+
+	SMTLIBSolverPool();
+
+	SmtlibSmtSolver* start();
+
+	void checkin(SmtlibSmtSolver* Solver);
+
+	/// Returns false if \p Solver should not be reused.
+	bool reusable(SmtlibSmtSolver* Solver);
+};
+
+#endif
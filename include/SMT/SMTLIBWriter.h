@@ -0,0 +1,132 @@
+/**
+ * An incremental SMT-LIB2 writer of z3 expressions.
+ */
+
+#ifndef SMT_SMTLIBWRITER_H
+#define SMT_SMTLIBWRITER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+#include <functional>
+#include <unordered_map>
+
+#include "z3++.h"
+
+/// It writes assertions to a channel, e.g. the pipe of a solver, and
+/// remembers what the channel has seen. Compared to z3::solver::to_smt2(),
+/// which prints a whole query with all its declarations:
+///
+/// - A symbol is declared once on the channel, before its first use.
+/// - A subterm occurring more than once in the assertions written by an
+///   add()/addAll() is defined once by define-fun, which the later
+///   assertions on the channel also refer to.
+/// - The text is written to the sink in chunks, so no string of the
+///   whole query is built (unless the sink is a string).
+///
+/// The declarations and definitions are scoped by push()/pop(), which do
+/// not write anything: the caller writes the matching (push)/(pop) commands
+/// after flush(). An operator unknown to the writer is printed by z3.
+class SMTLIBWriter {
+public:
+	typedef std::function<void(const char*, size_t)> Sink;
+
+	struct Statistics {
+		uint64_t Assertions = 0;
+		uint64_t Declarations = 0;
+		uint64_t Definitions = 0;
+		/// subterms printed by z3
+		uint64_t Fallbacks = 0;
+		uint64_t Bytes = 0;
+	};
+
+	explicit SMTLIBWriter(Sink Out);
+
+	/// Append to \p Out.
+	explicit SMTLIBWriter(std::string& Out);
+
+	explicit SMTLIBWriter(std::ostream& Out);
+
+	/// Write to a blocking file descriptor.
+	explicit SMTLIBWriter(int Fd);
+
+	/// It flushes the buffered text.
+	~SMTLIBWriter();
+
+	void add(const z3::expr& E);
+
+	/// Add \p Es, sharing their common subterms.
+	void addAll(const z3::expr_vector& Es);
+	void addAll(std::vector<z3::expr>::const_iterator Begin, std::vector<z3::expr>::const_iterator End);
+
+	/// Write a command (e.g. "(check-sat)") as is.
+	void command(const std::string& Cmd);
+
+	void push();
+	void pop(unsigned N = 1);
+
+	/// Forget all declarations and definitions, e.g. after (reset).
+	void reset();
+
+	/// Pass the buffered text to the sink.
+	void flush();
+
+	const Statistics& getStatistics() const {
+		return Stats;
+	}
+
+private:
+	Sink Out;
+
+	std::string Buffer;
+
+	/// decl id -> <decl, its symbol>, and ast id -> <term, its name>,
+	/// where the decls and terms are kept alive so that their ids are
+	/// not reused while they are on the channel
+	std::unordered_map<unsigned, std::pair<z3::func_decl, std::string>> Declared;
+	std::unordered_map<unsigned, std::pair<z3::expr, std::string>> Defined;
+
+	/// sort id -> <sort, its name>
+	std::unordered_map<unsigned, std::pair<z3::sort, std::string>> SortNames;
+
+	/// the ids declared and defined in each scope
+	struct Scope {
+		std::vector<unsigned> Declared;
+		std::vector<unsigned> Defined;
+	};
+	std::vector<Scope> Scopes;
+
+	Statistics Stats;
+
+	void write(const std::vector<z3::expr>& Batch);
+
+	void put(const char* Data, size_t Size);
+
+	void put(const std::string& S) {
+		put(S.data(), S.size());
+	}
+
+	void put(char C);
+
+	/// Declare the uninterpreted function of \p App if it is new.
+	void declare(z3::context& Ctx, Z3_app App);
+
+	/// Declare the uninterpreted functions in \p Root, which is printed by z3.
+	void declareAll(z3::context& Ctx, Z3_ast Root);
+
+	/// Returns false if \p App is not printed by the writer, in
+	/// which case its subterms are not shared.
+	bool printable(z3::context& Ctx, Z3_app App);
+
+	const std::string& sortName(z3::context& Ctx, Z3_sort Sort);
+
+	void printTerm(z3::context& Ctx, Z3_ast Root);
+
+	/// Print \p Node if it is a leaf (or defined, or printed by z3), and
+	/// return 0. Otherwise, print "(" and its operator, and return the
+	/// number of its arguments, which are printed by printTerm().
+	unsigned printOpen(z3::context& Ctx, Z3_ast Node);
+};
+
+#endif
@@ -6,11 +6,14 @@
 #define SMT_SMTMODEL_H
 
 #include <string>
+#include <vector>
+#include <cstdint>
 
 #include "z3++.h"
 #include "SMTObject.h"
 
 class SMTFactory;
+class SMTExprVec;
 
 class SMTModel : public SMTObject {
 private:
@@ -30,6 +33,30 @@ public:
 
 	std::pair<std::string, std::string> getModelDbgInfo(int Index);
 
+	/// Evaluate each of \p Exprs, bools or bit-vectors of at most 64 bits,
+	/// into \p Values (a bool is 1 or 0). The variables not in the model
+	/// take default values. Returns false if some expr has no such value,
+	/// in which case its value is 0.
+	bool evalUint64(const SMTExprVec& Exprs, std::vector<uint64_t>& Values);
+
+	/// Evaluate each of \p Exprs, bools or bit-vectors of any width, into
+	/// little-endian 64-bit words. The value of Exprs[I] is in Words[Offsets[I]]
+	/// to Words[Offsets[I + 1] - 1], so Offsets has one more element than
+	/// Exprs. Returns false if some expr has no such value, in which case
+	/// its words are 0.
+	bool evalWords(const SMTExprVec& Exprs, std::vector<uint64_t>& Words, std::vector<size_t>& Offsets);
+
+	/// A model keeping only the interpretations of the variables in \p Vars.
+	SMTModel project(const SMTExprVec& Vars);
+
+	/// The constants interpreted by the model. The I-th constant is the
+	/// I-th item of getModelDbgInfo() and of getAssignment().
+	SMTExprVec getConstants();
+
+	/// The values of getConstants() in the layout of evalWords(). The
+	/// constants that are not bools or bit-vectors (e.g. arrays) take no words.
+	void getAssignment(std::vector<uint64_t>& Words, std::vector<size_t>& Offsets);
+
 	friend class SMTSolver;
 };
 
@@ -0,0 +1,69 @@
+/**
+ * A pool of recent models for answering sat queries without solving.
+ */
+
+#ifndef SMT_SMTMODELPOOL_H
+#define SMT_SMTMODELPOOL_H
+
+#include <deque>
+#include <memory>
+#include <cstdint>
+
+#include "z3++.h"
+
+/// It keeps the most recent models found by the solvers of a factory.
+/// Since most sat queries extend earlier sat queries, a query is often
+/// satisfied by one of the recent models, which can be checked by model
+/// evaluation (with model completion) instead of solving.
+///
+/// The pool is not locked. The evaluation uses the z3::context of the
+/// factory, so the threads sharing the factory must hold its FactoryLock
+/// while checking.
+class SMTModelPool {
+public:
+	struct Statistics {
+		/// queries checked against the pool
+		uint64_t Attempts = 0;
+		/// queries answered by a pooled model
+		uint64_t Reuses = 0;
+		/// time spent on evaluating models, in microseconds
+		uint64_t PreCheckTimeUs = 0;
+	};
+
+	/// A capacity of 0 disables the pool.
+	explicit SMTModelPool(size_t Capacity = 0);
+
+	bool enabled() const {
+		return Capacity > 0;
+	}
+
+	size_t size() const {
+		return Models.size();
+	}
+
+	/// Returns a model satisfying all \p Assertions, or nullptr. The
+	/// model is a copy of the pooled one, owned by the caller.
+	std::shared_ptr<z3::model> findModelOf(const z3::expr_vector& Assertions);
+
+	/// The pool keeps a copy of \p Model, since the model completion
+	/// of findModelOf() changes the pooled models.
+	void insert(const z3::model& Model);
+
+	void clear() {
+		Models.clear();
+	}
+
+	const Statistics& getStatistics() const {
+		return Stats;
+	}
+
+private:
+	size_t Capacity;
+
+	Statistics Stats;
+
+	/// The most recently used models are at the front.
+	std::deque<std::shared_ptr<z3::model>> Models;
+};
+
+#endif
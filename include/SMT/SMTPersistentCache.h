@@ -0,0 +1,57 @@
+/**
+ * A persistent query result cache shared between processes and runs.
+ */
+
+#ifndef SMT_SMTPERSISTENTCACHE_H
+#define SMT_SMTPERSISTENTCACHE_H
+
+#include <string>
+#include <cstdint>
+
+#include "SMTSolver.h"
+#include "SMTFingerprint.h"
+
+/// An open-addressing hash table in a memory-mapped file, from query
+/// fingerprints (see SMTFingerprint) to results and solving time.
+///
+/// Processes mapping the same file share the table. Slots are claimed with
+/// atomic compare-and-swap on the shared mapping and are never removed, so
+/// concurrent readers and writers need no lock. When the probing sequence
+/// of a query is full, the result is simply not recorded.
+///
+/// The cache is enabled by -solver-persistent-cache=<file>.
+class SMTPersistentCache {
+public:
+	/// Returns nullptr if the persistent cache is disabled
+	/// or the cache file cannot be used.
+	static SMTPersistentCache* get();
+
+	~SMTPersistentCache();
+
+	/// Returns true and sets \p Result and \p SolveTimeUs (the time in
+	/// microseconds that was spent to obtain \p Result) on a hit.
+	bool lookup(const SMTFingerprint& Key, SMTSolver::SMTResultType& Result, uint64_t& SolveTimeUs);
+
+	/// A definitive result overwrites an unknown one, but not vice versa.
+	void insert(const SMTFingerprint& Key, SMTSolver::SMTResultType Result, uint64_t SolveTimeUs);
+
+	/// The number of recorded queries (by all processes).
+	uint64_t size() const;
+
+	uint64_t capacity() const;
+
+private:
+	struct Header;
+	struct Slot;
+
+	int FD;
+	size_t MappedSize;
+	Header* Head;
+	Slot* Slots;
+
+	SMTPersistentCache(int FD, size_t MappedSize, void* Mapped);
+
+	static SMTPersistentCache* open(const std::string& Path, uint64_t NumSlots);
+};
+
+#endif
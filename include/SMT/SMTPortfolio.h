@@ -0,0 +1,100 @@
+/**
+ * A multi-threaded portfolio of z3 tactics.
+ */
+
+#ifndef SMT_SMTPORTFOLIO_H
+#define SMT_SMTPORTFOLIO_H
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+#include <llvm/Support/raw_ostream.h>
+
+#include "z3++.h"
+
+/// It solves a query by several configurations at the same time, each of
+/// which runs in its own thread on its own z3::context. The first
+/// definitive (sat or unsat) answer is returned and the other threads
+/// are stopped by Z3_interrupt.
+///
+/// The configurations are given by -solver-portfolio, a comma separated
+/// list of z3 tactic names, each optionally followed by "@<random seed>",
+/// e.g. -solver-portfolio=smt,qfbv,smt@7. The name "default" denotes the
+/// default z3 solver.
+class SMTPortfolio {
+public:
+	struct MemberStatistics {
+		std::string Name;
+		/// queries in which the member has been run
+		uint64_t Runs = 0;
+		/// queries answered by the member
+		uint64_t Wins = 0;
+		/// total time of the won queries, in microseconds
+		uint64_t WinTimeUs = 0;
+	};
+
+	/// Returns nullptr if no portfolio is configured.
+	static SMTPortfolio* get();
+
+	/// Solve \p Assertions (of any z3::context) with a timeout in ms (0 for
+	/// no timeout). If the result is sat, \p Model is set to a model
+	/// translated into the context of \p Assertions.
+	///
+	/// It may be called concurrently, but the context of \p Assertions is
+	/// accessed by the calling thread only.
+	z3::check_result check(const z3::expr_vector& Assertions, unsigned TimeoutMs, std::shared_ptr<z3::model>& Model);
+
+	/// Stop the checks of the queries of context \p Origin, which return
+	/// unknown. It may be called by any thread.
+	void interrupt(Z3_context Origin);
+
+	std::vector<MemberStatistics> getStatistics();
+
+	void printStatistics(llvm::raw_ostream& O);
+
+private:
+	struct Member {
+		std::string Tactic;
+		/// 0 means that the seed is not set
+		unsigned Seed = 0;
+	};
+
+	/// One context for each member. A lane is used by one query at a time,
+	/// and is reused by later queries to avoid creating contexts.
+	struct Lane {
+		std::vector<std::unique_ptr<z3::context>> Contexts;
+	};
+
+	/// The state of the members solving one query
+	struct Race {
+		/// the context of the query
+		Z3_context Origin;
+		std::mutex RaceLock;
+		std::condition_variable RaceCond;
+		int Winner = -1;
+		size_t NumFinished = 0;
+		bool Interrupted = false;
+	};
+
+	std::vector<Member> Members;
+
+	std::mutex PortfolioLock;
+
+	std::vector<MemberStatistics> Stats;
+
+	std::vector<std::unique_ptr<Lane>> FreeLanes;
+
+	/// The races in progress, for interrupt()
+	std::vector<Race*> Races;
+
+	explicit SMTPortfolio(const std::vector<std::string>& Specs);
+
+	std::unique_ptr<Lane> acquireLane();
+
+	void releaseLane(std::unique_ptr<Lane> L);
+};
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * Query result cache shared by the solvers of one SMTFactory.
+ */
+
+#ifndef SMT_SMTQUERYCACHE_H
+#define SMT_SMTQUERYCACHE_H
+
+#include <list>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "z3++.h"
+#include "SMTSolver.h"
+
+/// A bounded LRU cache from assertion sets to their (sat/unsat) results.
+///
+/// A query is identified by the sorted set of the AST ids of its assertions,
+/// i.e., the order and the duplication of the assertions do not matter.
+/// Since Z3 recycles the ids of dead ASTs, every entry pins its assertions
+/// so that an id in the cache always denotes the same formula.
+///
+/// Ids are only meaningful in one z3::context, so a cache must not be shared
+/// across SMTFactory instances.
+///
+/// It has no lock of its own. Like the exprs of its factory, it may be used
+/// by one thread at a time, i.e. the threads sharing the factory must hold
+/// its FactoryLock while checking (SMTSolver::checkWithCaches() asserts it).
+class SMTQueryCache {
+public:
+	struct Statistics {
+		uint64_t Hits = 0;
+		uint64_t Misses = 0;
+		uint64_t Evictions = 0;
+	};
+
+	/// A capacity of 0 disables the cache.
+	explicit SMTQueryCache(size_t Capacity = 0);
+
+	bool enabled() const {
+		return Capacity > 0;
+	}
+
+	size_t capacity() const {
+		return Capacity;
+	}
+
+	size_t size() const {
+		return Entries.size();
+	}
+
+	/// Shrinking the capacity evicts the least recently used entries.
+	void setCapacity(size_t Cap);
+
+	/// Returns true and sets \p Result if \p Assertions have been solved.
+	bool lookup(const z3::expr_vector& Assertions, SMTSolver::SMTResultType& Result);
+
+	/// Only definitive results (sat or unsat) are recorded.
+	void insert(const z3::expr_vector& Assertions, SMTSolver::SMTResultType Result);
+
+	void clear();
+
+	const Statistics& getStatistics() const {
+		return Stats;
+	}
+
+private:
+	typedef std::vector<unsigned> KeyTy;
+
+	struct KeyHash {
+		size_t operator()(const KeyTy& Key) const;
+	};
+
+	struct Entry {
+		const KeyTy* Key;
+		z3::expr_vector Pinned;
+		SMTSolver::SMTResultType Result;
+	};
+
+	typedef std::list<Entry> EntryList;
+
+	size_t Capacity;
+
+	Statistics Stats;
+
+	/// Most recently used entries are at the front.
+	EntryList Entries;
+
+	std::unordered_map<KeyTy, EntryList::iterator, KeyHash> Index;
+
+	static KeyTy makeKey(const z3::expr_vector& Assertions);
+
+	void evict();
+};
+
+#endif
@@ -6,7 +6,9 @@
 #define SMT_SMTSOLVER_H
 
 #include <vector>
+#include <memory>
 #include <llvm/Support/Debug.h>
+#include <llvm/Support/raw_ostream.h>
 
 #include "z3++.h"
 #include "SMTObject.h"
@@ -18,6 +20,10 @@ class SMTModel;
 class SMTExpr;
 class SMTExprVec;
 class MessageQueue;
+class SMTCheckFuture;
+class SMTVarEliminator;
+class SMTFragment;
+class SMTFragmentClassifier;
 
 
 
@@ -33,14 +39,166 @@ public:
 private:
     z3::solver Solver;
 
+    /// It is set when the last check() is answered without solving
+    /// (e.g. by the query cache). In that case, Solver has no model
+    /// and getSMTModel() needs to solve the assertions first.
+    bool ModelPending = false;
+
+    /// If the last check() has recorded an unsat core of the
+    /// assertions in the unsat core cache of the factory.
+    bool CoreRecorded = false;
+
+    /// A model of the assertions found without solving them
+    /// (e.g. by the model pool), returned by getSMTModel().
+    std::shared_ptr<z3::model> WitnessModel;
+
+    /// The assertions of the sat components of the last checkSliced()
+    /// whose models are not in WitnessModel (e.g. answered by the
+    /// component cache). getSMTModel() solves them to complete it, and
+    /// fails if they are not solved, e.g. at the timeout.
+    std::shared_ptr<z3::expr_vector> UnmodeledAssertions;
+
+    /// The backend or cache answering the last check(), for telemetry.
+    const char* LastBackend = "z3";
+
+    /// Why the last check() returned unknown, if the backend tells,
+    /// e.g. "timeout" when an SMTLIB solver misses its deadline.
+    std::string ReasonUnknown;
+
+    /// The statistics of the z3 solvers that solved the last check(), e.g.
+    /// the reduced solver of -solver-eliminate-vars, for telemetry. They are
+    /// only collected when the telemetry is enabled.
+    std::vector<std::pair<std::string, double>> Z3Statistics;
+
+    /// The incremental state of -solver-simplify, shared by the copies of
+    /// the solver like the z3 solver. See checkSimplified().
+    struct SimplifyState;
+    std::shared_ptr<SimplifyState> Simplification;
+
+    /// The indicator literals of checkAssuming(), shared by the copies
+    /// of the solver like the z3 solver.
+    struct AssumptionState;
+    std::shared_ptr<AssumptionState> Assumptions;
+
+    /// The assertion trail for fork(), shared by the copies of the solver
+    /// like the z3 solver. See materialize().
+    struct TrailNode;
+    struct ForkState;
+    std::shared_ptr<ForkState> Fork;
+
+    /// The constraints buffered by add() when -solver-lazy-add is enabled,
+    /// shared by the copies of the solver like the z3 solver.
+    struct AddBuffer;
+    std::shared_ptr<AddBuffer> Buffer;
+
+    /// The preprocessing of -solver-eliminate-vars, shared by the copies
+    /// of the solver like the z3 solver. See eliminateVariables().
+    std::shared_ptr<SMTVarEliminator> Elimination;
+
+    /// The fragment (e.g. QF_BV or QF_LIA) of the assertions, which is
+    /// updated as they are added, and decides the logic declared to the
+    /// SMTLIB solvers and the z3 solver of -solver-route-by-logic. It is
+    /// shared by the copies of the solver like the z3 solver.
+    std::shared_ptr<SMTFragmentClassifier> Fragments;
+
+    /// The state of the external solver of -enable-incremental-smtlib-solver,
+    /// which mirrors the scopes of the z3 solver. It is shared by the copies
+    /// of the solver, which share the external solver.
+    struct SMTLIBMirror;
+    std::shared_ptr<SMTLIBMirror> Mirror;
+
+    /// Send the declarations and assertions that are added since the
+    /// last flush to the external solver.
+    void flushToSMTLIB();
+
+    /// Bring the z3 solver up to date before it is used, e.g. by check().
+    /// A forked solver only records add/push/pop in its trail until the
+    /// trail is replayed here, and the buffered constraints are flushed.
+    void materialize();
+
+    void replayTrail();
+
+    /// Add to (or push) the z3 solver and the states mirroring its scopes.
+    void assertNow(const z3::expr& E);
+    void pushNow();
+
+    /// It is recorded by SMTFactory::createSMTSolverWithTactic for fork().
+    void setTacticName(const std::string& Tactic);
+
     SMTSolver(SMTFactory* F, z3::solver& Z3Solver);
 
+    /// Answer the query by the caches of the factory if possible,
+    /// otherwise solve it by checkSliced() or checkBackend(). It asserts
+    /// that no other thread is checking a solver of the factory.
+    SMTResultType checkWithCaches();
+
+    /// Solve the assertions by solveByBackend(), and record the
+    /// query in the fragment statistics of the factory.
+    SMTResultType checkBackend();
+
+    /// The same for the assertions of \p Target, of fragment \p Fragment,
+    /// which is Solver or a solver of a subset of its assertions.
+    SMTResultType checkBackend(z3::solver& Target, const SMTFragment& Fragment);
+
+    /// Solve the assertions of \p Input using the configured backend,
+    /// i.e., z3, smtd or an SMTLIB solver. The incremental backends
+    /// (-solver-simplify and incremental SMTLIB solvers) mirror Solver,
+    /// so for them \p Input must be Solver.
+    SMTResultType solveByBackend(z3::solver& Input, const SMTFragment& Fragment);
+
+    /// Add the statistics of \p Z3Solver, which has solved the last check()
+    /// (or one of its components), to Z3Statistics.
+    void collectZ3Statistics(const z3::solver& Z3Solver);
+
+    /// A new z3 solver using the tactic and the timeout of this solver.
+    z3::solver newZ3Solver();
+
+    /// Eliminate the variables defined by \p Assertions, and set \p Reduced
+    /// to a solver of the reduced assertions using the same tactic, which
+    /// is reused by the later checks with the same definitions (see
+    /// SMTVarEliminator::getReducedSolver()). Returns false if nothing is eliminated. A model of \p Reduced is
+    /// extended to the eliminated variables by Elimination->reconstruct().
+    bool eliminateVariables(const z3::expr_vector& Assertions, z3::solver& Reduced);
+
+    /// Solve the simplified assertions (-solver-simplify) in a solver kept
+    /// in sync with push/pop. Only the assertions added since the last
+    /// check are simplified, and the simplified forms are memoized.
+    z3::check_result checkSimplified();
+
+    /// Simplify the assertions added since the last flush, and add them
+    /// to the simplification solver in the current scope.
+    void flushToSimplification();
+
+    /// The assertions of Solver, without the guards of checkAssuming().
+    z3::expr_vector queryAssertions();
+
+    /// The model of Solver, without the indicator literals of checkAssuming().
+    z3::model getZ3Model();
+
+    /// The pairs of <indicator literal, assumption> in \p Used
+    /// whose literals are in the unsat core of the z3 solver.
+    std::vector<std::pair<z3::expr, z3::expr>> coreOf(const std::vector<std::pair<z3::expr, z3::expr>>& Used);
+
+    /// Split \p Assertions into components that do not share variables
+    /// (or uninterpreted functions), and solve each component separately by
+    /// the configured backend. The results of the components are cached in
+    /// the factory, so an unchanged component is solved once. The models of
+    /// the components are merged into WitnessModel.
+    ///
+    /// The incremental backends (-solver-simplify and incremental SMTLIB
+    /// solvers) solve the whole query, since they mirror the scopes of
+    /// Solver.
+    SMTResultType checkSliced(const z3::expr_vector& Assertions);
+
+    /// Extract an unsat core of the unsat \p Assertions, by solving them
+    /// again on a new z3 solver with one tracking literal per assertion,
+    /// and record it in the factory's unsat core cache.
+    void recordUnsatCore(const z3::expr_vector& Assertions);
+
 public:
 
     // { Begin of SMTLIB solver related staff
     SmtlibSmtSolver *SmtlibSolver; 	// For communicating with SMTLIB solvers
-    // NOTE:the following vectors are used for debugging
-    PushPopVec<std::string> AssertionsCache; // replace the above two
     // } End
 
     virtual ~SMTSolver();
@@ -57,6 +215,46 @@ public:
 
     virtual SMTResultType check();
 
+    /// Run check() in a background thread, and return a handle to wait
+    /// for, cancel or be notified of the result (see SMTCheckFuture.h).
+    /// The solver and its factory must not be used by other threads
+    /// without the FactoryLock until the check completes.
+    SMTCheckFuture checkAsync();
+
+    /// Check the assertions together with \p Assumptions, without
+    /// changing the scopes of the solver. Each assumption A is guarded by
+    /// an indicator literal p, i.e. "p => A" is asserted in the current
+    /// scope when A is first used, and p is passed to z3 as an assumption.
+    /// The guard is reused by later calls until its scope is popped.
+    ///
+    /// The guards are kept out of assertions(), the models, and the
+    /// queries of check() (e.g. its cache keys and the queries sent to
+    /// the other backends). The caches of check() are not used.
+    SMTResultType checkAssuming(SMTExprVec Assumptions);
+
+    /// The assumptions responsible for the unsat result of the last
+    /// checkAssuming(), or an empty vector if it is not unsat. If
+    /// \p Minimize is true, the core is minimized by deletion, i.e.
+    /// an assumption is dropped if the rest are still unsat, which
+    /// needs a solver call per assumption in the core.
+    SMTExprVec getUnsatCore(bool Minimize = false);
+
+    /// Why the last check() returned unknown, or "" if it is not
+    /// unknown or the backend does not tell.
+    const std::string& getReasonUnknown() const {
+        return ReasonUnknown;
+    }
+
+    /// Create an independent solver (using the same tactic) with the same
+    /// assertions and scopes. Different from copying, which shares the z3
+    /// solver, later changes to either solver do not affect the other.
+    ///
+    /// It is O(1): both solvers share an immutable trail of the
+    /// assertions and push markers, and the new solver replays the trail
+    /// into its own z3 solver only when it is checked (or its assertions,
+    /// model, etc. are needed).
+    SMTSolver fork();
+
     SMTModel getSMTModel();
 
     SMTExprVec assertions();
@@ -72,11 +270,13 @@ public:
     bool operator<(const SMTSolver& Solver) const;
 
     friend std::ostream & operator<<(std::ostream & O, SMTSolver& Solver) {
+        Solver.materialize();
         O << Solver.Solver.to_smt2() << "\n";
         return O;
     }
 
     friend llvm::raw_ostream & operator<<(llvm::raw_ostream & O, SMTSolver& Solver) {
+        Solver.materialize();
         O << Solver.Solver.to_smt2() << "\n";
         return O;
     }
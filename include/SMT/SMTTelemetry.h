@@ -0,0 +1,132 @@
+/**
+ * Per-query telemetry of the solvers of a factory.
+ */
+
+#ifndef SMT_SMTTELEMETRY_H
+#define SMT_SMTTELEMETRY_H
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <llvm/Support/raw_ostream.h>
+
+#include "z3++.h"
+#include "SMTSolver.h"
+
+/// It measures the wall time and the CPU time of the calling thread.
+/// Unlike clock(), which is the CPU time of the whole process, it is
+/// meaningful when several threads are solving.
+class SMTStopwatch {
+public:
+	SMTStopwatch();
+
+	uint64_t getWallTimeUs() const;
+
+	uint64_t getThreadCPUTimeUs() const;
+
+private:
+	std::chrono::steady_clock::time_point WallStart;
+	uint64_t CPUStartUs;
+};
+
+/// A latency histogram with logarithmic buckets. Each power of two is
+/// split into four buckets, so a percentile is accurate to within 25%.
+class SMTLatencyHistogram {
+public:
+	void add(uint64_t Us);
+
+	uint64_t count() const {
+		return Count;
+	}
+
+	uint64_t total() const {
+		return Total;
+	}
+
+	uint64_t max() const {
+		return Max;
+	}
+
+	/// The upper bound of the bucket containing the \p P-th (in [0, 1])
+	/// percentile. It is 0 if the histogram is empty.
+	uint64_t percentile(double P) const;
+
+private:
+	std::vector<uint64_t> Buckets;
+	uint64_t Count = 0;
+	uint64_t Total = 0;
+	uint64_t Max = 0;
+
+	static unsigned bucketOf(uint64_t Us);
+	static uint64_t upperBoundOf(unsigned Bucket);
+};
+
+/// When -solver-telemetry is enabled, each SMTSolver::check() is recorded
+/// in the telemetry of the solver's factory, under the factory's current
+/// tag (see SMTFactory::setTelemetryTag), e.g. the name of the analysis
+/// pass issuing the queries. The latencies are aggregated per factory and
+/// per tag, and the recent queries are kept for export to JSON or CSV.
+///
+/// It can be read and exported by any thread.
+class SMTTelemetry {
+public:
+	struct QueryRecord {
+		std::string Tag;
+		/// e.g. z3, portfolio, smtlib, query-cache, see SMTSolver::check()
+		std::string Backend;
+		SMTSolver::SMTResultType Result = SMTSolver::SMTRT_Uncheck;
+		uint64_t WallTimeUs = 0;
+		uint64_t CPUTimeUs = 0;
+		unsigned NumAssertions = 0;
+		/// the number of distinct nodes of the assertions
+		unsigned DagSize = 0;
+		/// Z3_solver_get_statistics, if the query is solved by z3 natively
+		std::vector<std::pair<std::string, double>> Z3Statistics;
+	};
+
+	struct Summary {
+		/// indexed by SMTSolver::SMTResultType
+		uint64_t Results[4] = { 0, 0, 0, 0 };
+		std::map<std::string, uint64_t> Backends;
+		SMTLatencyHistogram WallTime;
+		SMTLatencyHistogram CPUTime;
+	};
+
+	/// If -solver-telemetry is enabled.
+	static bool enabled();
+
+	/// The number of distinct nodes of \p Assertions.
+	static unsigned dagSize(const z3::expr_vector& Assertions);
+
+	void record(QueryRecord R);
+
+	Summary getSummary();
+
+	std::map<std::string, Summary> getTagSummaries();
+
+	std::vector<QueryRecord> getRecords();
+
+	/// The summaries (with p50/p99 latencies) and the recent queries.
+	void writeJSON(llvm::raw_ostream& O);
+
+	/// The recent queries, one per line.
+	void writeCSV(llvm::raw_ostream& O);
+
+	void clear();
+
+private:
+	std::mutex TelemetryLock;
+
+	Summary Total;
+
+	std::map<std::string, Summary> Tags;
+
+	/// at most -solver-telemetry-records recent queries
+	std::deque<QueryRecord> Records;
+};
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * A cache of unsat cores for subset-based unsat detection.
+ */
+
+#ifndef SMT_SMTUNSATCORECACHE_H
+#define SMT_SMTUNSATCORECACHE_H
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include "z3++.h"
+
+/// It records unsat cores and answers whether a set of assertions
+/// includes any recorded core, in which case the set is unsat.
+///
+/// Cores are stored in a trie over their sorted AST ids, so that a subset
+/// query only walks the branches labeled with the ids of the queried set.
+/// Like SMTQueryCache, it pins the exprs of the cores and is only valid
+/// in one z3::context. It is not locked either, so the threads sharing its
+/// factory must hold the FactoryLock while checking.
+class SMTUnsatCoreCache {
+public:
+	struct Statistics {
+		uint64_t Hits = 0;
+		uint64_t Misses = 0;
+		uint64_t Cores = 0;
+		/// times the trie is dropped because it is full
+		uint64_t Flushes = 0;
+	};
+
+	/// A capacity (the max number of cores) of 0 disables the cache.
+	explicit SMTUnsatCoreCache(size_t Capacity = 0);
+
+	bool enabled() const {
+		return Capacity > 0;
+	}
+
+	size_t size() const {
+		return NumCores;
+	}
+
+	/// Returns true if \p Assertions include a recorded unsat core.
+	bool containsCoreOf(const z3::expr_vector& Assertions);
+
+	void insert(const z3::expr_vector& Core);
+
+	void clear();
+
+	const Statistics& getStatistics() const {
+		return Stats;
+	}
+
+private:
+	struct TrieNode {
+		/// A core ends at this node
+		bool Terminal = false;
+		std::map<unsigned, std::unique_ptr<TrieNode>> Children;
+		/// The exprs of the core ending at this node
+		std::vector<z3::expr> Pinned;
+	};
+
+	size_t Capacity;
+
+	size_t NumCores = 0;
+
+	Statistics Stats;
+
+	TrieNode Root;
+
+	static std::vector<unsigned> sortedIds(const z3::expr_vector& Exprs);
+
+	/// The number of cores ending at \p Node or below it
+	static size_t countCores(const TrieNode& Node);
+
+	static bool search(const TrieNode& Node, const std::vector<unsigned>& Ids, size_t From);
+};
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * Variable elimination of the solved-form equalities in a query.
+ */
+
+#ifndef SMT_SMTVARELIMINATOR_H
+#define SMT_SMTVARELIMINATOR_H
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include "z3++.h"
+
+/// It finds the top-level conjuncts of a query in solved form, i.e.
+/// "x == t" (or "t == x") where x is a variable not occurring in t,
+/// and the boolean literals "p" and "!p". Each such variable is
+/// eliminated by substituting its definition into the other conjuncts.
+/// A variable is defined by its first solved form; the later ones are
+/// kept as constraints. Definitions referring to each other are
+/// resolved, and the ones forming a cycle are kept as constraints.
+///
+/// The substituted conjuncts are cached by their AST ids until the
+/// definitions change, so that an incremental solver, whose assertions
+/// mostly grow between checks, substitutes each assertion once. For the
+/// same reason, the solver of the reduced query (see getReducedSolver())
+/// is kept while the definitions are unchanged, and only the new reduced
+/// conjuncts are added to it.
+///
+/// A model of the reduced query is extended to the original query by
+/// reconstruct(), which evaluates the definitions in the model.
+class SMTVarEliminator {
+public:
+	struct Statistics {
+		uint64_t Eliminated = 0;
+		uint64_t Substituted = 0;
+		uint64_t CacheHits = 0;
+	};
+
+	explicit SMTVarEliminator(z3::context& Ctx);
+
+	/// Returns false if no variable in \p Assertions can be eliminated.
+	/// Otherwise, the reduced query is in getReduced().
+	bool eliminate(const z3::expr_vector& Assertions);
+
+	const z3::expr_vector& getReduced() const {
+		return Reduced;
+	}
+
+	/// A solver holding the reduced query of the last (successful)
+	/// eliminate(). It is created by \p Create if the definitions have
+	/// changed. Otherwise the solver of the previous call is reused: the
+	/// reduced conjuncts no longer in the query are popped, and the new
+	/// ones are added in a new scope.
+	z3::solver getReducedSolver(const std::function<z3::solver()>& Create);
+
+	/// Add the eliminated variables of the last eliminate() to \p M,
+	/// a model of the reduced query.
+	void reconstruct(z3::model& M);
+
+	const Statistics& getStatistics() const {
+		return Stats;
+	}
+
+private:
+	z3::context& Ctx;
+
+	/// The eliminated variables and their definitions, which contain
+	/// no eliminated variables.
+	z3::expr_vector Vars;
+	z3::expr_vector Defs;
+
+	z3::expr_vector Reduced;
+
+	/// The definitions for which Cache and ReducedSolver are valid, kept
+	/// alive so that their ids are not reused.
+	z3::expr_vector CachedVars;
+	z3::expr_vector CachedDefs;
+
+	/// If the last eliminate() has changed the definitions
+	bool DefinitionsChanged = true;
+
+	/// The conjuncts added to ReducedSolver, with a scope pushed before
+	/// each batch; a batch starts at InSolver[Batches[I]].
+	std::unique_ptr<z3::solver> ReducedSolver;
+	std::vector<z3::expr> InSolver;
+	std::vector<size_t> Batches;
+
+	/// assertion id -> <assertion, substituted assertion>
+	std::unordered_map<unsigned, std::pair<z3::expr, z3::expr>> Cache;
+
+	Statistics Stats;
+
+	/// Returns true if \p E is in solved form, defining \p Var as \p Def.
+	bool solvedForm(const z3::expr& E, z3::expr& Var, z3::expr& Def);
+
+	/// The candidates (by \p Candidates, mapping variable ids to
+	/// candidate indices) whose variables occur in \p E.
+	std::vector<size_t> dependencies(const z3::expr& E, const std::unordered_map<unsigned, size_t>& Candidates);
+};
+
+#endif
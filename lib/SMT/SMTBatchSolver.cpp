@@ -0,0 +1,146 @@
+/**
+ * A thread pool for solving independent queries in batches.
+ */
+
+#include <llvm/Support/CommandLine.h>
+
+#include <iostream>
+
+#include "SMT/SMTBatchSolver.h"
+#include "SMT/SMTFactory.h"
+
+static llvm::cl::opt<unsigned> BatchThreads("solver-batch-threads", llvm::cl::init(0),
+        llvm::cl::desc("The number of worker threads solving batched queries. 0 means the number of hardware threads."));
+
+struct SMTBatchSolver::Batch {
+	const std::vector<SMTExprVec>* Queries;
+	std::vector<SMTSolver::SMTResultType> Results;
+
+	std::mutex BatchLock;
+	std::condition_variable BatchCond;
+	size_t Remaining;
+};
+
+SMTBatchSolver& SMTBatchSolver::get() {
+	// The workers are never joined, so the pool is never destroyed.
+	static SMTBatchSolver* Pool = nullptr;
+	static std::once_flag PoolFlag;
+	std::call_once(PoolFlag, []() {
+		unsigned N = BatchThreads.getValue();
+		if (N == 0) {
+			N = std::thread::hardware_concurrency();
+		}
+		Pool = new SMTBatchSolver(N == 0 ? 1 : N);
+	});
+	return *Pool;
+}
+
+SMTBatchSolver::SMTBatchSolver(unsigned N) : NumWorkers(N) {
+	for (unsigned I = 0; I < NumWorkers; I++) {
+		Queues.emplace_back(new WorkQueue());
+	}
+	for (unsigned I = 0; I < NumWorkers; I++) {
+		Workers.emplace_back(&SMTBatchSolver::work, this, I);
+		Workers.back().detach();
+	}
+}
+
+std::vector<SMTSolver::SMTResultType> SMTBatchSolver::solve(const std::vector<SMTExprVec>& Queries) {
+	if (Queries.empty()) {
+		return std::vector<SMTSolver::SMTResultType>();
+	}
+
+	Batch B;
+	B.Queries = &Queries;
+	B.Results.resize(Queries.size(), SMTSolver::SMTRT_Unknown);
+	B.Remaining = Queries.size();
+
+	// Give each worker a contiguous chunk; the owner takes tasks from the
+	// front of its queue and thieves take them from the back.
+	size_t N = Queries.size();
+	for (unsigned W = 0; W < NumWorkers; W++) {
+		size_t Begin = N * W / NumWorkers, End = N * (W + 1) / NumWorkers;
+		if (Begin == End) {
+			continue;
+		}
+		std::lock_guard<std::mutex> L(Queues[W]->QueueLock);
+		for (size_t I = Begin; I < End; I++) {
+			Queues[W]->Tasks.push_back(Task{&B, I});
+		}
+	}
+	{
+		std::lock_guard<std::mutex> L(IdleLock);
+		PendingTasks += N;
+	}
+	IdleCond.notify_all();
+
+	std::unique_lock<std::mutex> L(B.BatchLock);
+	B.BatchCond.wait(L, [&B]() { return B.Remaining == 0; });
+	return B.Results;
+}
+
+bool SMTBatchSolver::popTask(unsigned WorkerId, Task& T) {
+	{
+		WorkQueue& Own = *Queues[WorkerId];
+		std::lock_guard<std::mutex> L(Own.QueueLock);
+		if (!Own.Tasks.empty()) {
+			T = Own.Tasks.front();
+			Own.Tasks.pop_front();
+			return true;
+		}
+	}
+
+	for (unsigned I = 1; I < NumWorkers; I++) {
+		WorkQueue& Victim = *Queues[(WorkerId + I) % NumWorkers];
+		std::lock_guard<std::mutex> L(Victim.QueueLock);
+		if (!Victim.Tasks.empty()) {
+			T = Victim.Tasks.back();
+			Victim.Tasks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+void SMTBatchSolver::work(unsigned WorkerId) {
+	// The thread-local factory, which lives as long as the worker, so that
+	// its caches are shared by all the queries solved by this worker.
+	SMTFactory Factory;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> L(IdleLock);
+			IdleCond.wait(L, [this]() { return PendingTasks > 0; });
+		}
+
+		Task T;
+		if (!popTask(WorkerId, T)) {
+			// another worker has taken the last tasks
+			std::this_thread::yield();
+			continue;
+		}
+		{
+			std::lock_guard<std::mutex> L(IdleLock);
+			PendingTasks--;
+		}
+
+		SMTSolver::SMTResultType Result = SMTSolver::SMTRT_Unknown;
+		try {
+			SMTExprVec Query = Factory.translate((*T.Owner->Queries)[T.Index]);
+			SMTSolver Solver = Factory.createSMTSolver();
+			for (unsigned I = 0, E = Query.size(); I < E; I++) {
+				Solver.add(Query[I]);
+			}
+			Result = Solver.check();
+		} catch (z3::exception &Ex) {
+			std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+		}
+
+		Batch& B = *T.Owner;
+		std::lock_guard<std::mutex> L(B.BatchLock);
+		B.Results[T.Index] = Result;
+		if (--B.Remaining == 0) {
+			B.BatchCond.notify_all();
+		}
+	}
+}
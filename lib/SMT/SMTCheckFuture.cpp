@@ -0,0 +1,119 @@
+/**
+ * A handle of an asynchronous SMTSolver::check().
+ */
+
+#include <thread>
+#include <iostream>
+
+#include "SMT/SMTCheckFuture.h"
+#include "SMT/SMTFactory.h"
+#include "SMT/SMTPortfolio.h"
+
+SMTCheckFuture SMTCheckFuture::launch(SMTSolver* Solver, Z3_context Ctx) {
+	SMTCheckFuture Ret;
+	Ret.State = std::make_shared<SharedState>();
+	Ret.State->Ctx = Ctx;
+
+	std::shared_ptr<SharedState> S = Ret.State;
+	std::thread([S, Solver]() {
+		SMTSolver::SMTResultType Result = SMTSolver::SMTRT_Unknown;
+		{
+			std::lock_guard<std::mutex> L(Solver->getSMTFactory().getFactoryLock());
+			bool Started;
+			{
+				// From now on, the context is used by this thread only,
+				// so cancel() may interrupt it.
+				std::lock_guard<std::mutex> G(S->StateLock);
+				Started = S->Started = !S->Cancelled;
+			}
+			if (Started) {
+				try {
+					Result = Solver->check();
+				} catch (z3::exception &Ex) {
+					std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+				}
+			}
+
+			// Once the FactoryLock is released, other threads may solve
+			// on the context, so cancel() must stop interrupting it.
+			std::lock_guard<std::mutex> G(S->StateLock);
+			S->Finished = true;
+		}
+
+		std::vector<CallbackTy> Callbacks;
+		{
+			std::lock_guard<std::mutex> G(S->StateLock);
+			S->Result = Result;
+			S->Done = true;
+			Callbacks.swap(S->Callbacks);
+			S->Cond.notify_all();
+		}
+		for (auto& Callback : Callbacks) {
+			Callback(Result);
+		}
+	}).detach();
+
+	return Ret;
+}
+
+bool SMTCheckFuture::ready() const {
+	std::lock_guard<std::mutex> L(State->StateLock);
+	return State->Done;
+}
+
+void SMTCheckFuture::wait() const {
+	std::unique_lock<std::mutex> L(State->StateLock);
+	State->Cond.wait(L, [this]() { return State->Done; });
+}
+
+SMTSolver::SMTResultType SMTCheckFuture::get() const {
+	std::unique_lock<std::mutex> L(State->StateLock);
+	State->Cond.wait(L, [this]() { return State->Done; });
+	return State->Result;
+}
+
+void SMTCheckFuture::cancel() {
+	std::unique_lock<std::mutex> L(State->StateLock);
+	if (State->Done) {
+		return;
+	}
+	State->Cancelled = true;
+
+	// Before the check starts, the background thread is waiting for the
+	// FactoryLock, and other threads may be solving on the context. It will
+	// see the flag and skip the check, so do not interrupt the context.
+	if (!State->Started) {
+		State->Cond.wait(L, [this]() { return State->Done; });
+		return;
+	}
+
+	// An interruption arriving before z3 starts solving
+	// may be missed, so interrupt until the check stops.
+	SMTPortfolio* Portfolio = SMTPortfolio::get();
+	while (!State->Finished) {
+		Z3_interrupt(State->Ctx);
+		if (Portfolio) {
+			Portfolio->interrupt(State->Ctx);
+		}
+		State->Cond.wait_for(L, std::chrono::milliseconds(5));
+	}
+	State->Cond.wait(L, [this]() { return State->Done; });
+}
+
+bool SMTCheckFuture::cancelled() const {
+	std::lock_guard<std::mutex> L(State->StateLock);
+	return State->Cancelled;
+}
+
+void SMTCheckFuture::then(CallbackTy Callback) {
+	SMTSolver::SMTResultType Result;
+	{
+		std::lock_guard<std::mutex> L(State->StateLock);
+		if (!State->Done) {
+			State->Callbacks.push_back(std::move(Callback));
+			return;
+		}
+		Result = State->Result;
+	}
+	Callback(Result);
+}
@@ -18,6 +18,33 @@ static llvm::cl::opt<std::string> UsingSMTLIBSolver("use-smtlib-solver", llvm::c
         llvm::cl::desc("Use SMTLIB2 solver to solve the query."));
 
 
+unsigned SMTConfig::SMTLIBSolverTimeout;
+static llvm::cl::opt<unsigned, true> SMTLIBSolverTimeoutOpt("smtlib-solver-timeout", llvm::cl::location(SMTConfig::SMTLIBSolverTimeout),
+        llvm::cl::init(10000),
+        llvm::cl::desc("Kill and restart an SMTLIB solver that does not answer a query in this time (ms), "
+                "taking the result as unknown. It backs up the time limit passed to the solver. 0 means no limit."));
+
+
+std::vector<SMTConfig::SMTLIBSolverSpec> SMTConfig::SMTLIBPortfolio;
+static llvm::cl::list<std::string> SMTLIBPortfolioNames("smtlib-portfolio", llvm::cl::CommaSeparated,
+        llvm::cl::desc("Solve each non-incremental query with these SMTLIB solvers (z3, cvc5, btor, yices2) in parallel, "
+                "e.g. z3,cvc5, and take the first answer. It implies -use-smtlib-solver, "
+                "whose solver defaults to the first one here."));
+
+
+std::string SMTConfig::SMTLIBLogic;
+static llvm::cl::opt<std::string, true> SMTLIBLogicOpt("smtlib-logic", llvm::cl::location(SMTConfig::SMTLIBLogic),
+        llvm::cl::init("auto"),
+        llvm::cl::desc("The logic declared to SMTLIB solvers, e.g. QF_BV or ALL. "
+                "auto means the smallest logic of the assertions, e.g. QF_ABV or QF_LIA."));
+
+std::string SMTConfig::SMTLIBFallbackLogic;
+static llvm::cl::opt<std::string, true> SMTLIBFallbackLogicOpt("smtlib-fallback-logic",
+        llvm::cl::location(SMTConfig::SMTLIBFallbackLogic), llvm::cl::init("QF_BV"),
+        llvm::cl::desc("The logic declared by -smtlib-logic=auto when no standard logic fits the assertions "
+                "(e.g. int2bv mixes), e.g. ALL for the solvers accepting it."));
+
+
 bool SMTConfig::UseIncrementalSMTLIBSolver;
 static llvm::cl::opt<bool> EnableIncrementalSMTLIBSolver("enable-incremental-smtlib-solver", llvm::cl::init(false),
         llvm::cl::desc("Using incremental when SMTLIB sovler is chosen"));
@@ -58,34 +85,47 @@ void SMTConfig::init() {
 //    else z3::set_param("inc_qfbv", 4); // Default changes to pp_qfbv_light_tactic
 
 
-    if (UsingSMTLIBSolver.getNumOccurrences()) {
+    if (UsingSMTLIBSolver.getNumOccurrences() || !SMTLIBPortfolioNames.empty()) {
         SMTConfig::UseSMTLIBSolver = true;
         if (EnableIncrementalSMTLIBSolver.getValue()) {
            SMTConfig::UseIncrementalSMTLIBSolver = true;
         } else {
            SMTConfig::UseIncrementalSMTLIBSolver = false;
         }
-        std::string& SolverName = UsingSMTLIBSolver.getValue();
-        if (SolverName == "z3") {
-            SMTConfig::SMTLIBSolverPath = z3_path;
-            SMTConfig::SMTLIBSolverArgs = z3_args;
-        } else if (SolverName == "cvc5") {
-            SMTConfig::SMTLIBSolverPath = cvc5_path;
-            SMTConfig::SMTLIBSolverArgs = cvc5_args;
-            if (SMTConfig::UseIncrementalSMTLIBSolver) SMTConfig::SMTLIBSolverArgs.push_back("--incremental");
-        } else if (SolverName == "btor") {
-            SMTConfig::SMTLIBSolverPath = btor_path;
-            SMTConfig::SMTLIBSolverArgs = btor_args;
-        } else if (SolverName == "yices2") {
-            SMTConfig::SMTLIBSolverPath = yices2_path;
-            SMTConfig::SMTLIBSolverArgs = yices2_args;
-            if (SMTConfig::UseIncrementalSMTLIBSolver) SMTConfig::SMTLIBSolverArgs.push_back("--incremental");
-        } else {
-            SMTConfig::SMTLIBSolverPath = z3_path;
-            SMTConfig::SMTLIBSolverArgs = z3_args;
+        std::string SolverName = UsingSMTLIBSolver.getNumOccurrences() ? UsingSMTLIBSolver.getValue()
+                : SMTLIBPortfolioNames.front();
+        SMTLIBSolverSpec Spec = getSMTLIBSolverSpec(SolverName, SMTConfig::UseIncrementalSMTLIBSolver);
+        SMTConfig::SMTLIBSolverPath = Spec.Path;
+        SMTConfig::SMTLIBSolverArgs = Spec.Args;
+
+        // the portfolio solves the whole query, so it is not incremental
+        SMTConfig::SMTLIBPortfolio.clear();
+        for (auto& Name : SMTLIBPortfolioNames) {
+            SMTConfig::SMTLIBPortfolio.push_back(getSMTLIBSolverSpec(Name, false));
         }
     } else {
         SMTConfig::UseSMTLIBSolver = false;
     }
 }
 
+SMTConfig::SMTLIBSolverSpec SMTConfig::getSMTLIBSolverSpec(const std::string& Name, bool Incremental) {
+    SMTLIBSolverSpec Spec;
+    Spec.Name = Name;
+    if (Name == "cvc5") {
+        Spec.Path = cvc5_path;
+        Spec.Args = cvc5_args;
+        if (Incremental) Spec.Args.push_back("--incremental");
+    } else if (Name == "btor") {
+        Spec.Path = btor_path;
+        Spec.Args = btor_args;
+    } else if (Name == "yices2") {
+        Spec.Path = yices2_path;
+        Spec.Args = yices2_args;
+        if (Incremental) Spec.Args.push_back("--incremental");
+    } else {
+        Spec.Path = z3_path;
+        Spec.Args = z3_args;
+    }
+    return Spec;
+}
+
@@ -0,0 +1,299 @@
+/**
+ * A budgeted engine of the contextual simplification by Dillig et al.
+ */
+
+#include <llvm/Support/CommandLine.h>
+
+#include <thread>
+#include <memory>
+#include <iostream>
+#include <unordered_set>
+
+#include "SMT/SMTDilligSimplifier.h"
+
+static llvm::cl::opt<unsigned> DilligTimeBudget("dillig-time-budget", llvm::cl::init(10000),
+        llvm::cl::desc("Stop the dillig simplification of a formula (or of the new assertions of a check "
+                "with -solver-simplify=dillig) after this time (ms), keeping the partially simplified formula. "
+                "0 means no limit."));
+
+static llvm::cl::opt<unsigned> DilligCallBudget("dillig-call-budget", llvm::cl::init(0),
+        llvm::cl::desc("Stop the dillig simplification of a formula (or of the new assertions of a check "
+                "with -solver-simplify=dillig) after this number of solver calls, keeping the partially "
+                "simplified formula. 0 means no limit."));
+
+static llvm::cl::opt<unsigned> DilligThreads("dillig-threads", llvm::cl::init(1),
+        llvm::cl::desc("Simplify the children of the root formula in parallel by this number of threads "
+                "in the dillig simplification."));
+
+static bool isConnective(const z3::expr& N, bool& IsOr) {
+	if (!N.is_app()) {
+		return false;
+	}
+	Z3_decl_kind Kind = N.decl().decl_kind();
+	IsOr = Kind == Z3_OP_OR;
+	return Kind == Z3_OP_AND || Kind == Z3_OP_OR;
+}
+
+static bool isKind(const z3::expr& N, Z3_decl_kind Kind) {
+	return N.is_app() && N.decl().decl_kind() == Kind;
+}
+
+static unsigned idOf(const z3::expr& N) {
+	return Z3_get_ast_id(N.ctx(), N);
+}
+
+bool SMTDilligSimplifier::Budget::consume() {
+	if (Exhausted) {
+		return false;
+	}
+	if ((HasDeadline && std::chrono::steady_clock::now() > Deadline)
+			|| (MaxCalls && Calls.fetch_add(1) >= MaxCalls)) {
+		Exhausted = true;
+		return false;
+	}
+	return true;
+}
+
+unsigned SMTDilligSimplifier::Budget::remainingMs() const {
+	auto Left = std::chrono::duration_cast<std::chrono::milliseconds>(Deadline - std::chrono::steady_clock::now());
+	// 0 would mean no timeout
+	return Left.count() > 0 ? (unsigned) Left.count() : 1;
+}
+
+SMTDilligSimplifier::SMTDilligSimplifier(z3::context& C) : Ctx(C), Solver4Sim(C), B(OwnBudget) {
+	if (DilligTimeBudget.getValue()) {
+		B.HasDeadline = true;
+		B.Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(DilligTimeBudget.getValue());
+	}
+	B.MaxCalls = DilligCallBudget.getValue();
+}
+
+SMTDilligSimplifier::SMTDilligSimplifier(z3::context& C, Budget& SharedBudget) :
+		Ctx(C), Solver4Sim(C), B(SharedBudget) {
+}
+
+z3::check_result SMTDilligSimplifier::checkLeaf(const z3::expr& N) {
+	if (B.HasDeadline) {
+		// a single call cannot exceed what is left of the budget
+		z3::params Z3Params(Ctx);
+		Z3Params.set("timeout", B.remainingMs());
+		Solver4Sim.set(Z3Params);
+	}
+	Stats.SolverCalls++;
+	Solver4Sim.push();
+	Solver4Sim.add(N);
+	z3::check_result Result = Solver4Sim.check();
+	Solver4Sim.pop();
+	return Result;
+}
+
+z3::expr SMTDilligSimplifier::simplify(const z3::expr& E) {
+	z3::expr Ret = simplify(E, 0, DilligThreads.getValue() > 1);
+	Stats.Exhausted = B.Exhausted;
+	return Ret;
+}
+
+uint64_t SMTDilligSimplifier::extendContext(uint64_t ContextHash, const z3::expr& Alpha) {
+	Pinned.push_back(Alpha);
+	uint64_t H = ContextHash ^ ((uint64_t) idOf(Alpha) * 0x9e3779b97f4a7c15ULL);
+	H ^= H >> 33;
+	H *= 0xff51afd7ed558ccdULL;
+	H ^= H >> 33;
+	return H;
+}
+
+z3::expr SMTDilligSimplifier::criticalConstraint(const std::vector<z3::expr>& C, size_t I, bool IsOr) {
+	z3::expr_vector Args(Ctx);
+	for (size_t J = 0; J < C.size(); J++) {
+		if (J != I) {
+			Args.push_back(IsOr ? !C[J] : C[J]);
+		}
+	}
+	return Args.empty() ? Ctx.bool_val(true) : z3::mk_and(Args);
+}
+
+z3::expr SMTDilligSimplifier::simplifyLeaf(const z3::expr& N, uint64_t ContextHash) {
+	MemoKey Key{idOf(N), ContextHash};
+	auto It = Memo.find(Key);
+	if (It != Memo.end()) {
+		Stats.MemoHits++;
+		return It->second == V_Unchanged ? N : Ctx.bool_val(It->second == V_True);
+	}
+
+	Verdict V = V_Unchanged;
+	try {
+		// 1. the leaf is false if it contradicts its critical constraint
+		if (!B.consume()) {
+			return N;
+		}
+		z3::check_result Result = checkLeaf(N);
+
+		if (Result == z3::check_result::unsat) {
+			V = V_False;
+		} else {
+			// 2. the leaf is true if it is implied by its critical constraint
+			if (!B.consume()) {
+				return N;
+			}
+			Result = checkLeaf(!N);
+
+			if (Result == z3::check_result::unsat) {
+				V = V_True;
+			}
+		}
+	} catch (z3::exception &Ex) {
+		std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+		return N;
+	}
+
+	Pinned.push_back(N);
+	Memo[Key] = V;
+	return V == V_Unchanged ? N : Ctx.bool_val(V == V_True);
+}
+
+z3::expr SMTDilligSimplifier::simplify(const z3::expr& N, uint64_t ContextHash, bool Speculate) {
+	bool IsOr;
+	if (!isConnective(N, IsOr)) {
+		return simplifyLeaf(N, ContextHash);
+	}
+
+	// The unit of AND (true) is dropped, and its zero (false) absorbs the
+	// connective; dually for OR.
+	Z3_decl_kind Unit = IsOr ? Z3_OP_FALSE : Z3_OP_TRUE;
+	Z3_decl_kind Zero = IsOr ? Z3_OP_TRUE : Z3_OP_FALSE;
+
+	std::vector<z3::expr> C;
+	std::unordered_set<unsigned> CSet;
+	for (unsigned I = 0, E = N.num_args(); I < E; I++) {
+		z3::expr Arg = N.arg(I);
+		if (isKind(Arg, Zero)) {
+			return Ctx.bool_val(IsOr);
+		} else if (!isKind(Arg, Unit) && CSet.insert(idOf(Arg)).second) {
+			C.push_back(Arg);
+		}
+	}
+
+	bool Changed = true, FirstSweep = true;
+	while (Changed) {
+		Changed = false;
+
+		std::vector<z3::expr> Speculated;
+		if (FirstSweep && Speculate && C.size() > 1 && !B.Exhausted) {
+			Speculated = speculate(C, ContextHash, IsOr);
+		}
+
+		for (size_t I = 0; I < C.size(); I++) {
+			z3::expr NewCi(Ctx);
+			if (!Speculated.empty() && !Changed) {
+				// no earlier sibling has changed in this sweep, so the
+				// critical constraint used by the speculation is current
+				NewCi = Speculated[I];
+				Stats.CommittedSpeculations++;
+			} else {
+				z3::expr Alpha = criticalConstraint(C, I, IsOr);
+				Solver4Sim.push();
+				Solver4Sim.add(Alpha);
+				NewCi = simplify(C[I], extendContext(ContextHash, Alpha), false);
+				Solver4Sim.pop();
+			}
+
+			if (!z3::eq(NewCi, C[I])) {
+				Changed = true;
+				C[I] = NewCi;
+			}
+
+			if (isKind(NewCi, Zero)) {
+				return Ctx.bool_val(IsOr);
+			}
+		}
+
+		FirstSweep = false;
+		if (B.Exhausted) {
+			// the formula is equivalent to the input at the end of any sweep
+			break;
+		}
+	}
+
+	z3::expr_vector Args(Ctx);
+	for (auto& Ci : C) {
+		if (!isKind(Ci, Unit)) {
+			Args.push_back(Ci);
+		}
+	}
+	if (Args.empty()) {
+		return Ctx.bool_val(!IsOr);
+	} else if (Args.size() == 1) {
+		return Args[0];
+	}
+	return IsOr ? z3::mk_or(Args) : z3::mk_and(Args);
+}
+
+std::vector<z3::expr> SMTDilligSimplifier::speculate(const std::vector<z3::expr>& C, uint64_t ContextHash, bool IsOr) {
+	struct Lane {
+		// declared first, so that it is destroyed last
+		std::unique_ptr<z3::context> LaneCtx;
+		std::vector<size_t> Indices;
+		std::unique_ptr<z3::expr_vector> Outer, Children, Alphas, Results;
+		Statistics LaneStats;
+	};
+
+	size_t NumLanes = std::min<size_t>(DilligThreads.getValue(), C.size());
+	std::vector<Lane> Lanes(NumLanes);
+	z3::expr_vector Outer = Solver4Sim.assertions();
+
+	// Translate on the calling thread, because Ctx must not
+	// be accessed concurrently.
+	for (size_t L = 0; L < NumLanes; L++) {
+		Lane& La = Lanes[L];
+		La.LaneCtx.reset(new z3::context());
+		z3::context& LCtx = *La.LaneCtx;
+		La.Outer.reset(new z3::expr_vector(LCtx, Z3_ast_vector_translate(Ctx, Outer, LCtx)));
+		La.Children.reset(new z3::expr_vector(LCtx));
+		La.Alphas.reset(new z3::expr_vector(LCtx));
+		La.Results.reset(new z3::expr_vector(LCtx));
+		for (size_t I = L; I < C.size(); I += NumLanes) {
+			La.Indices.push_back(I);
+			La.Children->push_back(z3::expr(LCtx, Z3_translate(Ctx, C[I], LCtx)));
+			La.Alphas->push_back(z3::expr(LCtx, Z3_translate(Ctx, criticalConstraint(C, I, IsOr), LCtx)));
+		}
+	}
+
+	std::vector<std::thread> Threads;
+	for (size_t L = 0; L < NumLanes; L++) {
+		Threads.emplace_back([this, &Lanes, L]() {
+			Lane& La = Lanes[L];
+			z3::context& LCtx = *La.LaneCtx;
+			SMTDilligSimplifier Sub(LCtx, B);
+			for (unsigned J = 0; J < La.Outer->size(); J++) {
+				Sub.Solver4Sim.add((*La.Outer)[J]);
+			}
+			for (unsigned J = 0; J < La.Children->size(); J++) {
+				z3::expr Alpha = (*La.Alphas)[J];
+				Sub.Solver4Sim.push();
+				Sub.Solver4Sim.add(Alpha);
+				La.Results->push_back(Sub.simplify((*La.Children)[J], Sub.extendContext(0, Alpha), false));
+				Sub.Solver4Sim.pop();
+			}
+			La.LaneStats = Sub.Stats;
+		});
+	}
+	for (auto& T : Threads) {
+		T.join();
+	}
+
+	std::vector<z3::expr> Ret(C.size(), Ctx.bool_val(true));
+	for (auto& La : Lanes) {
+		for (size_t J = 0; J < La.Indices.size(); J++) {
+			Ret[La.Indices[J]] = z3::expr(Ctx, Z3_translate(*La.LaneCtx, (*La.Results)[J], Ctx));
+		}
+		Stats.SolverCalls += La.LaneStats.SolverCalls;
+		Stats.MemoHits += La.LaneStats.MemoHits;
+		Stats.Speculations += La.Indices.size();
+		// the exprs die before their context
+		La.Outer.reset();
+		La.Children.reset();
+		La.Alphas.reset();
+		La.Results.reset();
+	}
+	return Ret;
+}
@@ -0,0 +1,188 @@
+/**
+ * A background writer dumping slow queries to files.
+ */
+
+#include <llvm/Support/CommandLine.h>
+
+#include <ctime>
+#include <thread>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "SMT/SMTDumpWriter.h"
+
+static llvm::cl::opt<std::string> DumpingConstraintsDst("dump-cnts-dst", llvm::cl::init(""),
+        llvm::cl::desc("If solving time is larger than the time that -dump-cnts-timeout, the constraints will be output the destination."));
+
+static llvm::cl::opt<unsigned> DumpingConstraintsRate("dump-cnts-rate", llvm::cl::init(60),
+        llvm::cl::desc("Dump at most this number of queries per minute. 0 means no limit."));
+
+static llvm::cl::opt<unsigned> DumpingConstraintsMaxMB("dump-cnts-max-mb", llvm::cl::init(1024),
+        llvm::cl::desc("Stop dumping when the dumped queries in -dump-cnts-dst take this size (MB). 0 means no limit."));
+
+static llvm::cl::opt<unsigned> DumpingConstraintsQueue("dump-cnts-queue", llvm::cl::init(16),
+        llvm::cl::desc("Drop the slow queries when this number of queries are waiting to be dumped."));
+
+static const char* ResultNames[] = { "unsat", "sat", "unknown", "uncheck" };
+
+SMTDumpWriter* SMTDumpWriter::get() {
+	static SMTDumpWriter* Writer = nullptr;
+	static std::once_flag WriterFlag;
+	std::call_once(WriterFlag, []() {
+		if (DumpingConstraintsDst.empty()) {
+			return;
+		}
+		Writer = new SMTDumpWriter(DumpingConstraintsDst.getValue());
+		// write the pending dumps at exit; the writer is never destroyed
+		std::atexit([]() { Writer->flush(); });
+	});
+	return Writer;
+}
+
+SMTDumpWriter::SMTDumpWriter(const std::string& D) : Dst(D) {
+	if (mkdir(Dst.c_str(), 0777) != 0 && errno != EEXIST) {
+		std::cerr << "Dump destination cannot be created: " << Dst << ": " << strerror(errno) << "\n";
+	}
+
+	// count the dumps of earlier runs for the size cap
+	if (DIR* Dir = opendir(Dst.c_str())) {
+		while (struct dirent* Ent = readdir(Dir)) {
+			std::string Name = Ent->d_name;
+			struct stat St;
+			if (Name.size() > 5 && Name.compare(Name.size() - 5, 5, ".smt2") == 0
+					&& stat((Dst + "/" + Name).c_str(), &St) == 0) {
+				DiskUsage += St.st_size;
+			}
+		}
+		closedir(Dir);
+	}
+
+	std::thread(&SMTDumpWriter::work, this).detach();
+}
+
+std::string SMTDumpWriter::pathOf(const SMTFingerprint& Key) const {
+	return Dst + "/" + Key.str() + ".smt2";
+}
+
+bool SMTDumpWriter::claim(const SMTFingerprint& Key) {
+	std::lock_guard<std::mutex> L(WriterLock);
+	std::string Name = Key.str();
+	if (Claimed.count(Name)) {
+		Stats.Duplicates++;
+		return false;
+	}
+
+	struct stat St;
+	if (stat(pathOf(Key).c_str(), &St) == 0) {
+		// dumped by an earlier run or another process
+		Claimed.insert(Name);
+		Stats.Duplicates++;
+		return false;
+	}
+
+	if (DumpingConstraintsMaxMB.getValue() && DiskUsage >= (uint64_t) DumpingConstraintsMaxMB.getValue() << 20) {
+		Stats.DiskLimited++;
+		return false;
+	}
+
+	auto Now = std::chrono::steady_clock::now();
+	while (!RecentClaims.empty() && Now - RecentClaims.front() > std::chrono::minutes(1)) {
+		RecentClaims.pop_front();
+	}
+	if (DumpingConstraintsRate.getValue() && RecentClaims.size() >= DumpingConstraintsRate.getValue()) {
+		Stats.RateLimited++;
+		return false;
+	}
+
+	if (Queue.size() >= DumpingConstraintsQueue.getValue()) {
+		Stats.QueueFull++;
+		return false;
+	}
+
+	Claimed.insert(Name);
+	RecentClaims.push_back(Now);
+	return true;
+}
+
+void SMTDumpWriter::submit(const SMTFingerprint& Key, std::string Query, uint64_t SolveTimeUs, unsigned TimeoutMs,
+		SMTSolver::SMTResultType Result) {
+	std::lock_guard<std::mutex> L(WriterLock);
+	DiskUsage += Query.size();
+	Queue.push_back(Job{Key, std::move(Query), SolveTimeUs, TimeoutMs, Result});
+	QueueCond.notify_one();
+}
+
+void SMTDumpWriter::flush() {
+	std::unique_lock<std::mutex> L(WriterLock);
+	IdleCond.wait(L, [this]() { return Queue.empty() && !Writing; });
+}
+
+SMTDumpWriter::Statistics SMTDumpWriter::getStatistics() {
+	std::lock_guard<std::mutex> L(WriterLock);
+	return Stats;
+}
+
+void SMTDumpWriter::work() {
+	while (true) {
+		Job J;
+		{
+			std::unique_lock<std::mutex> L(WriterLock);
+			QueueCond.wait(L, [this]() { return !Queue.empty(); });
+			J = std::move(Queue.front());
+			Queue.pop_front();
+			Writing = true;
+		}
+
+		write(J);
+
+		std::lock_guard<std::mutex> L(WriterLock);
+		Writing = false;
+		if (Queue.empty()) {
+			IdleCond.notify_all();
+		}
+	}
+}
+
+void SMTDumpWriter::write(const Job& J) {
+	// Write to a temporary file and rename it, so that
+	// no one sees a partial dump.
+	std::string Path = pathOf(J.Key);
+	std::string TmpPath = Dst + "/." + J.Key.str() + "." + std::to_string(getpid()) + ".tmp";
+
+	std::ofstream DstFile;
+	DstFile.open(TmpPath);
+	if (!DstFile.is_open()) {
+		std::cerr << "File cannot be opened: " << TmpPath << "\n";
+		std::lock_guard<std::mutex> L(WriterLock);
+		Stats.Failed++;
+		return;
+	}
+
+	DstFile << "; fingerprint: " << J.Key.str() << "\n";
+	DstFile << "; solving-time-ms: " << J.SolveTimeUs / 1000.0 << "\n";
+	DstFile << "; timeout-ms: " << J.TimeoutMs << "\n";
+	DstFile << "; result: " << ResultNames[J.Result] << "\n";
+	DstFile << "; dumped-at: " << time(nullptr) << "\n";
+	DstFile << J.Query << "\n";
+	DstFile.close();
+
+	bool Failed = DstFile.fail() || rename(TmpPath.c_str(), Path.c_str()) != 0;
+	if (Failed) {
+		std::cerr << "Dump cannot be written: " << Path << "\n";
+		unlink(TmpPath.c_str());
+	}
+
+	std::lock_guard<std::mutex> L(WriterLock);
+	if (Failed) {
+		Stats.Failed++;
+	} else {
+		Stats.Written++;
+	}
+}
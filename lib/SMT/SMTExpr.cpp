@@ -10,6 +10,7 @@
 
 #include "SMT/SMTExpr.h"
 #include "SMT/SMTFactory.h"
+#include "SMT/SMTDilligSimplifier.h"
 
 SMTExpr::SMTExpr(SMTFactory* F, z3::expr Z3Expr) : SMTObject(F),
 		Expr(Z3Expr) {
@@ -39,165 +40,9 @@ SMTExpr SMTExpr::localSimplify() {
 	return SMTExpr(&getSMTFactory(), Expr.simplify());
 }
 
-SMTExpr SMTExpr::dilligSimplify(SMTExpr N, z3::solver& Solver4Sim, z3::context& Ctx) {
-	if (!N.isLogicAnd() && !N.isLogicOr()) {
-		// A leaf
-		Solver4Sim.push();
-		Solver4Sim.add(N.Expr);
-		if (Solver4Sim.check() == z3::check_result::unsat) {
-			Solver4Sim.pop();
-			return SMTExpr(&getSMTFactory(), Ctx.bool_val(false));
-		}
-		Solver4Sim.pop();
-		Solver4Sim.push();
-		Solver4Sim.add(!N.Expr);
-		if (Solver4Sim.check() == z3::check_result::unsat) {
-			Solver4Sim.pop();
-			return SMTExpr(&getSMTFactory(), Ctx.bool_val(true));
-		}
-		Solver4Sim.pop();
-		return N;
-	} else {
-		// A connective (AND or OR)
-		assert(N.isLogicAnd() || N.isLogicOr());
-
-		std::vector<SMTExpr> C;
-		std::set<SMTExpr, SMTExprComparator> CSet;
-		for (unsigned I = 0, E = N.numArgs(); I < E; I++) {
-			if (N.getArg(I).isTrue()) {
-				if (N.isLogicAnd()) {
-					continue;
-				} else if (N.isLogicOr()) {
-					return SMTExpr(&getSMTFactory(), Ctx.bool_val(true));
-				}
-			} else if (N.getArg(I).isFalse()) {
-				if (N.isLogicAnd()) {
-					return SMTExpr(&getSMTFactory(), Ctx.bool_val(false));
-				} else if (N.isLogicOr()) {
-					continue;
-				}
-			}
-
-			if (!CSet.count(N.getArg(I))) {
-				C.push_back(N.getArg(I));
-				CSet.insert(N.getArg(I));
-			}
-		}
-
-		bool FixedPoint = false;
-		while (!FixedPoint) {
-			//std::cout << "............." << (void*) (Z3_ast) N.z3_expr << "\n\n";
-			FixedPoint = true;
-
-			for (size_t I = 0, E = C.size(); I < E; ++I) {
-				Z3_ast* Args = new Z3_ast[C.size() - 1];
-				for (size_t J = 0; J < C.size() - 1; J++) {
-					SMTExpr *Candidate = nullptr;
-					if (J < I) {
-						Candidate = &C[J];
-					} else {
-						assert(J + 1 < C.size());
-						Candidate = &C[J + 1];
-					}
-
-					if (N.isLogicOr()) {
-						Args[J] = !(*Candidate).Expr;
-					} else {
-						Args[J] = (*Candidate).Expr;
-					}
-				}
-				SMTExpr Alpha(&getSMTFactory(), to_expr(Ctx, Z3_mk_and(Ctx, C.size() - 1, Args)));
-				delete[] Args;
-
-				SMTExpr& Ci = C[I];
-
-				Solver4Sim.push();
-				Solver4Sim.add(Alpha.Expr);
-				SMTExpr NewCi = dilligSimplify(Ci, Solver4Sim, Ctx);
-				Solver4Sim.pop();
-
-				if (!z3::eq(Ci.Expr, NewCi.Expr)) {
-					if (FixedPoint)
-						FixedPoint = false;
-					C[I] = NewCi;
-				}
-
-				if (NewCi.isTrue() && N.isLogicOr()) {
-					return SMTExpr(&getSMTFactory(), Ctx.bool_val(true));
-				} else if (NewCi.isFalse() && N.isLogicAnd()) {
-					return SMTExpr(&getSMTFactory(), Ctx.bool_val(false));
-				}
-			}
-
-			// FIXME
-			FixedPoint = true;
-		}
-
-		if (N.isLogicAnd()) {
-			Z3_ast* Args = new Z3_ast[C.size()];
-			size_t J = 0;
-			for (size_t I = 0; I < C.size(); I++) {
-				if (C[I].isTrue()) {
-					continue;
-				}
-				Args[J++] = C[I].Expr;
-			}
-
-			if (J == 1) {
-				SMTExpr Ret(&getSMTFactory(), to_expr(Ctx, Args[0]));
-				delete[] Args;
-				return Ret;
-			}
-
-			if (J == 0) {
-				delete[] Args;
-				return SMTExpr(&getSMTFactory(), Ctx.bool_val(true));
-			}
-
-			SMTExpr Ret(&getSMTFactory(), to_expr(Ctx, Z3_mk_and(Ctx, J, Args)));
-			delete[] Args;
-
-			return Ret;
-		} else {
-			// is logic OR
-			Z3_ast* Args = new Z3_ast[C.size()];
-			size_t J = 0;
-			for (size_t I = 0; I < C.size(); I++) {
-				if (C[I].isFalse()) {
-					continue;
-				}
-				Args[J++] = C[I].Expr;
-			}
-
-			if (J == 1) {
-				SMTExpr Ret(&getSMTFactory(), to_expr(Ctx, Args[0]));
-				delete[] Args;
-				return Ret;
-			}
-
-			if (J == 0) {
-				delete[] Args;
-				return SMTExpr(&getSMTFactory(), Ctx.bool_val(false));
-			}
-
-			SMTExpr Ret(&getSMTFactory(), to_expr(Ctx, Z3_mk_or(Ctx, J, Args)));
-			delete[] Args;
-
-			return Ret;
-		}
-	}
-}
-
 SMTExpr SMTExpr::dilligSimplify() {
-	z3::context& Ctx = Expr.ctx();
-	z3::solver Solver4Sim(Ctx);
-	Solver4Sim.add(Ctx.bool_val(true));
-
-	//	std::cout << "\nstart...." << this->size() << "\n";
-	SMTExpr AftSim = dilligSimplify(*this, Solver4Sim, Ctx);
-	//	std::cout << "end..." << AftSim.size() << "\n";
-
-	return AftSim;
+	SMTDilligSimplifier Simplifier(Expr.ctx());
+	return SMTExpr(&getSMTFactory(), Simplifier.simplify(Expr));
 }
 
 unsigned SMTExpr::size(std::map<SMTExpr, unsigned, SMTExprComparator>& SizeCache) {
@@ -8,14 +8,31 @@
 #include "SMT/SMTFactory.h"
 #include "SMT/SMTConfigure.h"
 #include "SMT/SMTLIBSolver.h"
+#include "SMT/SMTBatchSolver.h"
 
 #define DEBUG_TYPE "smt-fctry"
 
+static llvm::cl::opt<unsigned> QueryCacheSize("solver-query-cache", llvm::cl::init(0),
+        llvm::cl::desc("Cache the results of at most this number of queries per factory (LRU). 0 disables the cache."));
+
+static llvm::cl::opt<unsigned> UnsatCoreCacheSize("solver-unsat-core-cache", llvm::cl::init(0),
+        llvm::cl::desc("Record at most this number of unsat cores per factory, and answer unsat for the queries "
+                "including any of them. 0 disables the cache."));
+
+static llvm::cl::opt<unsigned> ModelPoolSize("solver-model-reuse", llvm::cl::init(0),
+        llvm::cl::desc("Keep at most this number of recent models per factory, and answer sat for the queries "
+                "satisfied by any of them. 0 disables the model reuse."));
+
+static llvm::cl::opt<unsigned> ComponentCacheSize("solver-slicing-cache", llvm::cl::init(1 << 16),
+        llvm::cl::desc("Cache the results of at most this number of independent components per factory "
+                "when -solver-independence-slicing is enabled."));
 
 static int FactoryId = 0;
 
 SMTFactory::SMTFactory() :
-		TempSMTVaraibleIndex(0) {
+		TempSMTVaraibleIndex(0), CachesInUse(false), QueryCache(QueryCacheSize.getValue()),
+		UnsatCoreCache(UnsatCoreCacheSize.getValue()), ModelPool(ModelPoolSize.getValue()),
+		ComponentCache(ComponentCacheSize.getValue()) {
         if (SMTConfig::UseSMTLIBSolver) {
             FactoryId += 1; // for debugging
             useSMTLIBSolver = true;
@@ -49,6 +66,10 @@ SMTExpr SMTFactory::translate(const SMTExpr & Expr) {
     return Ret;
 }
 
+std::vector<SMTSolver::SMTResultType> SMTFactory::checkBatch(const std::vector<SMTExprVec>& Queries) {
+	return SMTBatchSolver::get().solve(Queries);
+}
+
 std::pair<SMTExprVec, bool> SMTFactory::rename(const SMTExprVec& Exprs, const std::string& RenamingSuffix,
         std::unordered_map<std::string, SMTExpr>& Mapping, SMTRenamingAdvisor* Advisor) {
 
@@ -259,9 +280,12 @@ SMTSolver SMTFactory::createSMTSolverWithTactic(const std::string& TmpTactic) {
         	SMTSolver Sol = SMTSolver(this, Ret);
                 SmtlibSmtSolver* SS = Sol.SmtlibSolver;
       		CreatedSMTSolvers.push_back(SS);
+        	Sol.setTacticName(TmpTactic);
         	return Sol;
         } else {
-        	return SMTSolver(this, Ret);
+        	SMTSolver Sol = SMTSolver(this, Ret);
+        	Sol.setTacticName(TmpTactic);
+        	return Sol;
         }
     }
 }
@@ -0,0 +1,239 @@
+/**
+ * Stable structural fingerprints of queries.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "SMT/SMTFingerprint.h"
+
+namespace {
+
+typedef std::pair<uint64_t, uint64_t> Hash128;
+
+// The finalizer of MurmurHash3
+uint64_t fmix(uint64_t K) {
+	K ^= K >> 33;
+	K *= 0xff51afd7ed558ccdULL;
+	K ^= K >> 33;
+	K *= 0xc4ceb9fe1a85ec53ULL;
+	K ^= K >> 33;
+	return K;
+}
+
+void combine(Hash128& H, uint64_t V) {
+	H.first = fmix(H.first ^ (V + 0x9e3779b97f4a7c15ULL + (H.first << 6)));
+	H.second = fmix(H.second ^ (V + 0xc2b2ae3d27d4eb4fULL + (H.second << 7)));
+}
+
+void combine(Hash128& H, const Hash128& V) {
+	combine(H, V.first);
+	combine(H, V.second);
+}
+
+void combine(Hash128& H, const char* Str) {
+	// FNV-1a, then mixed into both lanes
+	uint64_t S = 14695981039346656037ULL;
+	size_t Len = strlen(Str);
+	for (size_t I = 0; I < Len; I++) {
+		S ^= (unsigned char) Str[I];
+		S *= 1099511628211ULL;
+	}
+	combine(H, S);
+	combine(H, (uint64_t) Len);
+}
+
+Hash128 seed(uint64_t Tag) {
+	Hash128 H(0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL);
+	combine(H, Tag);
+	return H;
+}
+
+/// Hashes the nodes of a DAG bottom-up, each node only once.
+class FingerprintBuilder {
+private:
+	Z3_context Ctx;
+
+	std::unordered_map<unsigned, Hash128> AstHashes;
+	std::unordered_map<unsigned, Hash128> SortHashes;
+	std::unordered_map<unsigned, Hash128> DeclHashes;
+
+	Hash128 hashSort(Z3_sort S) {
+		unsigned Id = Z3_get_sort_id(Ctx, S);
+		auto It = SortHashes.find(Id);
+		if (It != SortHashes.end()) {
+			return It->second;
+		}
+		Hash128 H = seed(1);
+		combine(H, Z3_sort_to_string(Ctx, S));
+		SortHashes[Id] = H;
+		return H;
+	}
+
+	void hashSymbol(Hash128& H, Z3_symbol Sym) {
+		if (Z3_get_symbol_kind(Ctx, Sym) == Z3_INT_SYMBOL) {
+			combine(H, (uint64_t) Z3_get_symbol_int(Ctx, Sym));
+		} else {
+			combine(H, Z3_get_symbol_string(Ctx, Sym));
+		}
+	}
+
+	Hash128 hashDecl(Z3_func_decl D) {
+		unsigned Id = Z3_get_func_decl_id(Ctx, D);
+		auto It = DeclHashes.find(Id);
+		if (It != DeclHashes.end()) {
+			return It->second;
+		}
+
+		Hash128 H = seed(2);
+		combine(H, (uint64_t) Z3_get_decl_kind(Ctx, D));
+		hashSymbol(H, Z3_get_decl_name(Ctx, D));
+		combine(H, (uint64_t) Z3_get_domain_size(Ctx, D));
+		combine(H, hashSort(Z3_get_range(Ctx, D)));
+		for (unsigned I = 0, E = Z3_get_decl_num_parameters(Ctx, D); I < E; I++) {
+			switch (Z3_get_decl_parameter_kind(Ctx, D, I)) {
+			case Z3_PARAMETER_INT:
+				combine(H, (uint64_t) Z3_get_decl_int_parameter(Ctx, D, I));
+				break;
+			case Z3_PARAMETER_SYMBOL:
+				hashSymbol(H, Z3_get_decl_symbol_parameter(Ctx, D, I));
+				break;
+			case Z3_PARAMETER_SORT:
+				combine(H, hashSort(Z3_get_decl_sort_parameter(Ctx, D, I)));
+				break;
+			case Z3_PARAMETER_RATIONAL:
+				combine(H, Z3_get_decl_rational_parameter(Ctx, D, I));
+				break;
+			default:
+				// rarely used parameters, e.g. asts and func_decls
+				combine(H, Z3_func_decl_to_string(Ctx, D));
+				break;
+			}
+		}
+		DeclHashes[Id] = H;
+		return H;
+	}
+
+	/// Hash a node whose children (if any) have been hashed.
+	Hash128 hashNode(Z3_ast A) {
+		Hash128 H;
+		switch (Z3_get_ast_kind(Ctx, A)) {
+		case Z3_NUMERAL_AST:
+			H = seed(3);
+			combine(H, hashSort(Z3_get_sort(Ctx, A)));
+			combine(H, Z3_get_numeral_string(Ctx, A));
+			break;
+		case Z3_APP_AST: {
+			Z3_app App = Z3_to_app(Ctx, A);
+			H = seed(4);
+			combine(H, hashDecl(Z3_get_app_decl(Ctx, App)));
+			for (unsigned I = 0, E = Z3_get_app_num_args(Ctx, App); I < E; I++) {
+				combine(H, AstHashes.at(Z3_get_ast_id(Ctx, Z3_get_app_arg(Ctx, App, I))));
+			}
+			break;
+		}
+		case Z3_VAR_AST:
+			H = seed(5);
+			combine(H, (uint64_t) Z3_get_index_value(Ctx, A));
+			combine(H, hashSort(Z3_get_sort(Ctx, A)));
+			break;
+		default:
+			// quantifiers and others are rare in our queries
+			H = seed(6);
+			combine(H, Z3_ast_to_string(Ctx, A));
+			break;
+		}
+		return H;
+	}
+
+public:
+	explicit FingerprintBuilder(Z3_context C) : Ctx(C) {
+	}
+
+	Hash128 hash(Z3_ast Root) {
+		// iterative post-order traversal, since path conditions can be very deep
+		std::vector<std::pair<Z3_ast, bool>> Stack;
+		Stack.push_back(std::make_pair(Root, false));
+		while (!Stack.empty()) {
+			Z3_ast A = Stack.back().first;
+			bool Expanded = Stack.back().second;
+			unsigned Id = Z3_get_ast_id(Ctx, A);
+			if (AstHashes.count(Id)) {
+				Stack.pop_back();
+				continue;
+			}
+
+			if (!Expanded && Z3_get_ast_kind(Ctx, A) == Z3_APP_AST) {
+				Stack.back().second = true;
+				Z3_app App = Z3_to_app(Ctx, A);
+				for (unsigned I = 0, E = Z3_get_app_num_args(Ctx, App); I < E; I++) {
+					Z3_ast Arg = Z3_get_app_arg(Ctx, App, I);
+					if (!AstHashes.count(Z3_get_ast_id(Ctx, Arg))) {
+						Stack.push_back(std::make_pair(Arg, false));
+					}
+				}
+				continue;
+			}
+
+			AstHashes[Id] = hashNode(A);
+			Stack.pop_back();
+		}
+		return AstHashes.at(Z3_get_ast_id(Ctx, Root));
+	}
+};
+
+SMTFingerprint toFingerprint(const Hash128& H) {
+	SMTFingerprint Ret;
+	Ret.Hi = H.first;
+	Ret.Lo = H.second;
+	// 0 is reserved for "no fingerprint"
+	if (Ret.empty()) {
+		Ret.Lo = 1;
+	}
+	return Ret;
+}
+
+} // anonymous namespace
+
+std::string SMTFingerprint::str() const {
+	static const char* Digits = "0123456789abcdef";
+	std::string Ret(32, '0');
+	for (unsigned I = 0; I < 16; I++) {
+		Ret[15 - I] = Digits[(Hi >> (I * 4)) & 0xf];
+		Ret[31 - I] = Digits[(Lo >> (I * 4)) & 0xf];
+	}
+	return Ret;
+}
+
+SMTFingerprint SMTFingerprint::of(const z3::expr_vector& Assertions) {
+	if (Assertions.empty()) {
+		return toFingerprint(seed(7));
+	}
+
+	FingerprintBuilder Builder(Assertions.ctx());
+	std::vector<Hash128> Members;
+	Members.reserve(Assertions.size());
+	for (unsigned I = 0, E = Assertions.size(); I < E; I++) {
+		z3::expr A = Assertions[I];
+		if (A.is_true()) {
+			continue;
+		}
+		Members.push_back(Builder.hash(A));
+	}
+	std::sort(Members.begin(), Members.end());
+	Members.erase(std::unique(Members.begin(), Members.end()), Members.end());
+
+	Hash128 H = seed(7);
+	for (auto& M : Members) {
+		combine(H, M);
+	}
+	return toFingerprint(H);
+}
+
+SMTFingerprint SMTFingerprint::of(const z3::expr& Expr) {
+	FingerprintBuilder Builder(Expr.ctx());
+	return toFingerprint(Builder.hash(Expr));
+}
@@ -0,0 +1,276 @@
+/**
+ * Classification of queries into SMT-LIB fragments (logics).
+ */
+
+#include <unordered_set>
+
+#include "SMT/SMTFragment.h"
+
+/// It is cleared when it grows beyond this size, and the nodes visited
+/// afterwards are memoized again.
+static const size_t FragmentMemoSize = 1 << 16;
+
+/// The standard logics of SMT-LIB (without the QF_ prefix) whose names
+/// are composed by getLogic()
+static const std::unordered_set<std::string> StandardLogics = {
+	"UF", "BV", "ABV", "UFBV", "AUFBV", "AX",
+	"LIA", "LRA", "NIA", "NRA", "LIRA", "NIRA",
+	"UFLIA", "UFLRA", "UFNIA", "UFNRA", "ALIA", "ANIA", "AUFLIA", "AUFNIA", "AUFLIRA", "AUFNIRA"
+};
+
+/// The logics whose z3 solvers beat the incremental SMT core of z3: the
+/// nonlinear arithmetic (nlsat) is only used by their tactics. For the
+/// other logics (e.g. QF_BV and QF_LIA), solving each query by a fresh
+/// solver of the logic is slower than solving it incrementally.
+static const std::unordered_set<std::string> Z3Logics = { "QF_NIA", "QF_NRA" };
+
+std::string SMTFragment::getName() const {
+	static const std::pair<Feature, const char*> Names[] = {
+		{ BV, "bv" }, { Array, "array" }, { UF, "uf" }, { Int, "int" }, { Real, "real" },
+		{ NonLinear, "nonlinear" }, { Quantifier, "quantifier" }, { Other, "other" }
+	};
+	std::string Ret;
+	for (auto& N : Names) {
+		if (has(N.first)) {
+			if (!Ret.empty()) {
+				Ret += "+";
+			}
+			Ret += N.second;
+		}
+	}
+	return Ret.empty() ? "bool" : Ret;
+}
+
+std::string SMTFragment::getLogic() const {
+	bool Arith = has(Int) || has(Real);
+	if (has(Other) || (has(BV) && Arith)) {
+		return "ALL";
+	}
+
+	std::string Theories;
+	if (has(Array)) {
+		Theories += "A";
+	}
+	if (has(UF)) {
+		Theories += "UF";
+	}
+	if (has(BV)) {
+		Theories += "BV";
+	} else if (Arith) {
+		Theories += has(NonLinear) ? "N" : "L";
+		Theories += has(Int) && has(Real) ? "IRA" : (has(Int) ? "IA" : "RA");
+	} else if (has(Array) && !has(UF)) {
+		// arrays of Booleans
+		Theories += "X";
+	} else if (!has(UF)) {
+		// pure Boolean
+		Theories = "BV";
+	}
+
+	if (!StandardLogics.count(Theories)) {
+		return "ALL";
+	}
+	return has(Quantifier) ? Theories : "QF_" + Theories;
+}
+
+std::string SMTFragment::getZ3Logic() const {
+	std::string Logic = getLogic();
+	return Z3Logics.count(Logic) ? Logic : "";
+}
+
+void SMTFragmentClassifier::add(const z3::expr& E) {
+	if (Memo.size() >= FragmentMemoSize) {
+		Memo.clear();
+	}
+	Current |= classify(E.ctx(), E);
+}
+
+void SMTFragmentClassifier::push() {
+	Scopes.push_back(Current);
+}
+
+void SMTFragmentClassifier::pop(unsigned N) {
+	assert(N <= Scopes.size());
+	Current = Scopes[Scopes.size() - N];
+	Scopes.resize(Scopes.size() - N);
+}
+
+void SMTFragmentClassifier::reset() {
+	Current = 0;
+	Scopes.clear();
+}
+
+SMTFragment SMTFragmentClassifier::of(const z3::expr& E) {
+	SMTFragmentClassifier Classifier;
+	Classifier.add(E);
+	return Classifier.current();
+}
+
+unsigned SMTFragmentClassifier::sortFeatures(z3::context& Ctx, Z3_sort Sort) {
+	unsigned Id = Z3_get_sort_id(Ctx, Sort);
+	auto It = SortMemo.find(Id);
+	if (It != SortMemo.end()) {
+		return It->second.second;
+	}
+
+	unsigned Ret = 0;
+	switch (Z3_get_sort_kind(Ctx, Sort)) {
+	case Z3_BOOL_SORT:
+		break;
+	case Z3_BV_SORT:
+		Ret = SMTFragment::BV;
+		break;
+	case Z3_INT_SORT:
+		Ret = SMTFragment::Int;
+		break;
+	case Z3_REAL_SORT:
+		Ret = SMTFragment::Real;
+		break;
+	case Z3_ARRAY_SORT:
+		Ret = SMTFragment::Array | sortFeatures(Ctx, Z3_get_array_sort_domain(Ctx, Sort))
+				| sortFeatures(Ctx, Z3_get_array_sort_range(Ctx, Sort));
+		break;
+	case Z3_UNINTERPRETED_SORT:
+		Ret = SMTFragment::UF;
+		break;
+	default:
+		Ret = SMTFragment::Other;
+		break;
+	}
+	SortMemo.insert(std::make_pair(Id, std::make_pair(z3::sort(Ctx, Sort), Ret)));
+	return Ret;
+}
+
+unsigned SMTFragmentClassifier::operatorFeatures(z3::context& Ctx, Z3_ast Node) {
+	Z3_app App = Z3_to_app(Ctx, Node);
+	Z3_func_decl Decl = Z3_get_app_decl(Ctx, App);
+	unsigned NumArgs = Z3_get_app_num_args(Ctx, App);
+	auto IsNumeral = [&Ctx, App](unsigned I) {
+		return Z3_is_numeral_ast(Ctx, Z3_get_app_arg(Ctx, App, I));
+	};
+
+	switch (Z3_get_decl_kind(Ctx, Decl)) {
+	case Z3_OP_UNINTERPRETED:
+		return NumArgs > 0 ? SMTFragment::UF : 0;
+	case Z3_OP_MUL: {
+		// (* 2 x) is linear, but (* x y) is not
+		unsigned NumVariables = 0;
+		for (unsigned I = 0; I < NumArgs; I++) {
+			if (!IsNumeral(I)) {
+				NumVariables++;
+			}
+		}
+		return NumVariables > 1 ? SMTFragment::NonLinear : 0;
+	}
+	case Z3_OP_DIV:
+	case Z3_OP_IDIV:
+	case Z3_OP_MOD:
+	case Z3_OP_REM:
+		return NumArgs == 2 && IsNumeral(1) ? 0 : SMTFragment::NonLinear;
+	case Z3_OP_POWER:
+		return SMTFragment::NonLinear;
+	case Z3_OP_INT2BV:
+	case Z3_OP_BV2INT:
+		// the sort of the argument is not that of the node
+		return SMTFragment::BV | SMTFragment::Int;
+	case Z3_OP_PB_AT_MOST:
+	case Z3_OP_PB_AT_LEAST:
+	case Z3_OP_PB_LE:
+	case Z3_OP_PB_GE:
+	case Z3_OP_PB_EQ:
+		return SMTFragment::Other;
+	default:
+		return 0;
+	}
+}
+
+unsigned SMTFragmentClassifier::classify(z3::context& Ctx, Z3_ast Root) {
+	// an iterative post-order traversal: a node is finished after its children
+	std::vector<std::pair<Z3_ast, bool>> Worklist(1, std::make_pair(Root, false));
+	while (!Worklist.empty()) {
+		Z3_ast Node = Worklist.back().first;
+		bool Expanded = Worklist.back().second;
+		unsigned Id = Z3_get_ast_id(Ctx, Node);
+		if (Memo.count(Id)) {
+			Worklist.pop_back();
+			continue;
+		}
+
+		Z3_ast_kind Kind = Z3_get_ast_kind(Ctx, Node);
+		if (!Expanded && (Kind == Z3_APP_AST || Kind == Z3_QUANTIFIER_AST)) {
+			Worklist.back().second = true;
+			if (Kind == Z3_APP_AST) {
+				Z3_app App = Z3_to_app(Ctx, Node);
+				for (unsigned I = 0, E = Z3_get_app_num_args(Ctx, App); I < E; I++) {
+					Worklist.push_back(std::make_pair(Z3_get_app_arg(Ctx, App, I), false));
+				}
+			} else {
+				Worklist.push_back(std::make_pair(Z3_get_quantifier_body(Ctx, Node), false));
+			}
+			continue;
+		}
+		Worklist.pop_back();
+
+		unsigned Features = 0;
+		if (Kind == Z3_APP_AST) {
+			Z3_app App = Z3_to_app(Ctx, Node);
+			Features = sortFeatures(Ctx, Z3_get_sort(Ctx, Node)) | operatorFeatures(Ctx, Node);
+			for (unsigned I = 0, E = Z3_get_app_num_args(Ctx, App); I < E; I++) {
+				Features |= Memo.at(Z3_get_ast_id(Ctx, Z3_get_app_arg(Ctx, App, I))).second;
+			}
+		} else if (Kind == Z3_QUANTIFIER_AST) {
+			Features = SMTFragment::Quantifier
+					| Memo.at(Z3_get_ast_id(Ctx, Z3_get_quantifier_body(Ctx, Node))).second;
+			for (unsigned I = 0, E = Z3_get_quantifier_num_bound(Ctx, Node); I < E; I++) {
+				Features |= sortFeatures(Ctx, Z3_get_quantifier_bound_sort(Ctx, Node, I));
+			}
+		} else if (Kind == Z3_NUMERAL_AST || Kind == Z3_VAR_AST) {
+			Features = sortFeatures(Ctx, Z3_get_sort(Ctx, Node));
+		}
+		Memo.insert(std::make_pair(Id, std::make_pair(z3::expr(Ctx, Node), Features)));
+	}
+	return Memo.at(Z3_get_ast_id(Ctx, Root)).second;
+}
+
+void SMTFragmentStatistics::record(const SMTFragment& F, SMTSolver::SMTResultType Result, uint64_t TimeUs,
+		bool Routed) {
+	std::string Name = F.getName();
+	std::lock_guard<std::mutex> L(StatisticsLock);
+	auto It = Entries.find(Name);
+	if (It == Entries.end()) {
+		It = Entries.insert(std::make_pair(Name, Entry())).first;
+		It->second.Logic = F.getLogic();
+	}
+	Entry& E = It->second;
+	E.Queries++;
+	if (Result == SMTSolver::SMTRT_Sat) {
+		E.Sat++;
+	} else if (Result == SMTSolver::SMTRT_Unsat) {
+		E.Unsat++;
+	} else {
+		E.Unknown++;
+	}
+	E.TimeUs += TimeUs;
+	if (Routed) {
+		E.Routed++;
+	}
+}
+
+std::map<std::string, SMTFragmentStatistics::Entry> SMTFragmentStatistics::get() {
+	std::lock_guard<std::mutex> L(StatisticsLock);
+	return Entries;
+}
+
+void SMTFragmentStatistics::print(llvm::raw_ostream& O) {
+	for (auto& It : get()) {
+		const Entry& E = It.second;
+		O << It.first << " (" << E.Logic << "): " << E.Queries << " queries, " << E.Sat << " sat, "
+				<< E.Unsat << " unsat, " << E.Unknown << " unknown, " << (E.TimeUs / E.Queries)
+				<< "us per query, " << E.Routed << " routed\n";
+	}
+}
+
+void SMTFragmentStatistics::clear() {
+	std::lock_guard<std::mutex> L(StatisticsLock);
+	Entries.clear();
+}
@@ -0,0 +1,154 @@
+/**
+ * A portfolio of external SMTLIB solvers racing on each query.
+ */
+
+#include <chrono>
+#include <errno.h>
+#include <poll.h>
+
+#include "SMT/SMTLIBPortfolio.h"
+
+SMTLIBPortfolio* SMTLIBPortfolio::get() {
+	// destroyed at exit, which shuts down the processes
+	static std::unique_ptr<SMTLIBPortfolio> Portfolio(SMTConfig::SMTLIBPortfolio.empty() ? nullptr
+			: new SMTLIBPortfolio(SMTConfig::SMTLIBPortfolio));
+	return Portfolio.get();
+}
+
+SMTLIBPortfolio::SMTLIBPortfolio(const std::vector<SMTConfig::SMTLIBSolverSpec>& Specs) : Members(Specs) {
+	for (auto& Spec : Specs) {
+		MemberStatistics S;
+		S.Name = Spec.Name;
+		Stats.push_back(S);
+	}
+}
+
+std::unique_ptr<SMTLIBPortfolio::Lane> SMTLIBPortfolio::acquireLane() {
+	{
+		std::lock_guard<std::mutex> L(PortfolioLock);
+		if (!FreeLanes.empty()) {
+			std::unique_ptr<Lane> Ret = std::move(FreeLanes.back());
+			FreeLanes.pop_back();
+			return Ret;
+		}
+	}
+
+	std::unique_ptr<Lane> Ret(new Lane());
+	for (auto& Spec : Members) {
+		Ret->Solvers.emplace_back(new SmtlibSmtSolver(Spec.Path, Spec.Args));
+	}
+	return Ret;
+}
+
+void SMTLIBPortfolio::releaseLane(std::unique_ptr<Lane> L) {
+	std::lock_guard<std::mutex> G(PortfolioLock);
+	FreeLanes.push_back(std::move(L));
+}
+
+SMTLIBSolverResult SMTLIBPortfolio::check(const std::string& Query, std::string& ReasonUnknown) {
+	auto Start = std::chrono::steady_clock::now();
+	size_t NumMembers = Members.size();
+	std::unique_ptr<Lane> L = acquireLane();
+
+	for (auto& S : L->Solvers) {
+		S->sendWholeFormula(Query);
+	}
+	// The deadline of each member starts when its query is sent,
+	// so all of them have passed by this one.
+	bool HasDeadline = SMTConfig::SMTLIBSolverTimeout > 0;
+	auto Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SMTConfig::SMTLIBSolverTimeout);
+
+	int Winner = -1;
+	size_t NumAnswered = 0;
+	std::vector<bool> Answered(NumMembers, false);
+	std::vector<SMTLIBSolverResult> Results(NumMembers, SMTLIBSolverResult::SMTRT_Unknown);
+	std::vector<struct pollfd> Fds(NumMembers);
+	while (Winner == -1 && NumAnswered < NumMembers) {
+		for (size_t I = 0; I < NumMembers; I++) {
+			// a negative descriptor is ignored by poll()
+			Fds[I].fd = Answered[I] ? -1 : L->Solvers[I]->getOutputFd();
+			Fds[I].events = POLLIN;
+			Fds[I].revents = 0;
+		}
+		int Wait = -1;
+		if (HasDeadline) {
+			auto Remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+					Deadline - std::chrono::steady_clock::now()).count();
+			Wait = Remaining > 0 ? (int) Remaining : 0;
+		}
+		if (poll(Fds.data(), NumMembers, Wait) < 0 && errno != EINTR) {
+			break;
+		}
+
+		// It does not block, and it also detects the members
+		// that have missed their deadlines.
+		for (size_t I = 0; I < NumMembers; I++) {
+			if (!Answered[I] && L->Solvers[I]->pollCheckSatResult(Results[I])) {
+				Answered[I] = true;
+				NumAnswered++;
+				if (Winner == -1 && (Results[I] == SMTLIBSolverResult::SMTRT_Sat
+						|| Results[I] == SMTLIBSolverResult::SMTRT_Unsat)) {
+					Winner = (int) I;
+				}
+			}
+		}
+	}
+	auto Time = std::chrono::steady_clock::now() - Start;
+
+	SMTLIBSolverResult Ret = SMTLIBSolverResult::SMTRT_Unknown;
+	if (Winner != -1) {
+		Ret = Results[Winner];
+	} else {
+		for (size_t I = 0; I < NumMembers; I++) {
+			if (!ReasonUnknown.empty()) {
+				ReasonUnknown += "; ";
+			}
+			ReasonUnknown += Members[I].Name + ": " + L->Solvers[I]->getReasonUnknown();
+		}
+	}
+
+	// Clear the members for the next query. The ones still solving may
+	// not answer for a long time, so they are replaced.
+	for (size_t I = 0; I < NumMembers; I++) {
+		if (Answered[I]) {
+			L->Solvers[I]->reset();
+		} else {
+			L->Solvers[I]->restart("lost the race");
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> G(PortfolioLock);
+		for (size_t I = 0; I < NumMembers; I++) {
+			Stats[I].Runs++;
+			if (!Answered[I]) {
+				Stats[I].Losses++;
+			} else if ((int) I != Winner && Results[I] != SMTLIBSolverResult::SMTRT_Sat
+					&& Results[I] != SMTLIBSolverResult::SMTRT_Unsat) {
+				Stats[I].Failures++;
+			}
+		}
+		if (Winner != -1) {
+			Stats[Winner].Wins++;
+			Stats[Winner].WinTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(Time).count();
+		}
+	}
+
+	releaseLane(std::move(L));
+	return Ret;
+}
+
+std::vector<SMTLIBPortfolio::MemberStatistics> SMTLIBPortfolio::getStatistics() {
+	std::lock_guard<std::mutex> G(PortfolioLock);
+	return Stats;
+}
+
+void SMTLIBPortfolio::printStatistics(llvm::raw_ostream& O) {
+	for (auto& S : getStatistics()) {
+		O << S.Name << ": " << S.Wins << "/" << S.Runs << " wins";
+		if (S.Wins) {
+			O << ", " << (S.WinTimeUs / S.Wins) << "us per win";
+		}
+		O << ", " << S.Failures << " failures, " << S.Losses << " losses\n";
+	}
+}
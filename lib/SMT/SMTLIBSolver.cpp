@@ -11,6 +11,7 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/wait.h>
@@ -19,6 +20,7 @@
 #include <errno.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 
 #include <algorithm>
@@ -26,7 +28,10 @@
 #include <exception>
 #include <cstdio>
 #include <chrono>
+#include <cstring>
 
+// the environment passed to the solvers
+extern char** environ;
 
 
 SmtlibSmtSolver::SmtlibSmtSolver(std::string path,
@@ -52,49 +57,67 @@ SmtlibSmtSolver::~SmtlibSmtSolver() {
 void SmtlibSmtSolver::init() {
 	signal(SIGPIPE, SIG_IGN);
 
-	// get the pipes started
+	// get the pipes started. They are closed on exec, so that a solver
+	// does not inherit the pipes of the other solvers, which would keep
+	// them open after those solvers exit.
 	int pipeIn[2];
 	int pipeOut[2];
 	const int READ = 0;
 	const int WRITE = 1;
-        //if (pipe(pipeIn) != 0) { printf("%s\n", strerror(errno)); abort(); }
-        //if (pipe(pipeOut) != 0) { printf("%s\n", strerror(errno)); abort(); }
-	assert(pipe(pipeIn) == 0); // what is the reason of failure?
-	//assert(pipe(pipeOut) == 0); // what is the reason
-        if (pipe(pipeOut) != 0) { printf("%s\n", strerror(errno)); abort(); }
-   	// now start the child process, i.e., the solver
-	pid_t pid = fork();
-	assert(pid >= 0);
-	if (pid == 0) {
-		// Child process
-		// duplicate the fd so that standard input and output will be send to our pipes
-		dup2(pipeIn[READ], STDIN_FILENO);
-		dup2(pipeOut[WRITE], STDOUT_FILENO);
-		dup2(pipeOut[WRITE], STDERR_FILENO);
-		// we can now close everything since our child process will use std in and out to address the pipes
-		close(pipeIn[READ]);
-		close(pipeIn[WRITE]);
-		close(pipeOut[READ]);
-		close(pipeOut[WRITE]);
+	if (pipe2(pipeIn, O_CLOEXEC) != 0) { printf("%s\n", strerror(errno)); abort(); }
+	if (pipe2(pipeOut, O_CLOEXEC) != 0) { printf("%s\n", strerror(errno)); abort(); }
+
+	// Now start the child process, i.e., the solver. posix_spawn() does
+	// not copy the page tables of this process like fork() does, whose
+	// cost grows with the memory of the process and which may fail under
+	// memory pressure.
+	// In the child, standard input and output (and error) are redirected to
+	// our pipes, and the pipe descriptors are closed by exec.
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, pipeIn[READ], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, pipeOut[WRITE], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, pipeOut[WRITE], STDERR_FILENO);
+
+	// SIGPIPE is ignored here, but not in the solver
+	posix_spawnattr_t attributes;
+	posix_spawnattr_init(&attributes);
+	sigset_t defaultSignals;
+	sigemptyset(&defaultSignals);
+	sigaddset(&defaultSignals, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attributes, &defaultSignals);
+	posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGDEF);
+
+	std::vector<char*> argv;
+	argv.push_back((char*) path.c_str());
+	for (auto& arg : cmdLineArgs) {
+		argv.push_back((char*) arg.c_str());
+	}
+	argv.push_back(NULL);
 
-		const char **argv = new const char*[cmdLineArgs.size() + 2];
-		argv[0] = path.c_str();
-		for (int i = 1; i <= cmdLineArgs.size(); i++) {
-			argv[i] = cmdLineArgs[i - 1].c_str();
-		}
-		argv[cmdLineArgs.size() + 1] = NULL;
+	pid_t pid = 0;
+	int error = posix_spawn(&pid, path.c_str(), &actions, &attributes, argv.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attributes);
 
-		execv(path.c_str(), (char**) argv);  //"-smt2 -in"
-		// if we reach this point, execl was not successful
-		assert("Could not execute the solver correctly");
+	close(pipeOut[WRITE]);
+	close(pipeIn[READ]);
+	if (error != 0) {
+		std::cout << "Could not execute the solver " << path << ": " << strerror(error) << "\n";
+		close(pipeIn[WRITE]);
+		close(pipeOut[READ]);
+		processIdOfSolver = 0;
+		return;
 	}
-	// Parent Process
+
 	toSolver = pipeIn[WRITE];
 	fromSolver = pipeOut[READ];
-	close(pipeOut[WRITE]);
-	close(pipeIn[READ]);
 	processIdOfSolver = pid;
 
+	// so that writeCommand() can read the output while the pipe is full
+	fcntl(toSolver, F_SETFL, fcntl(toSolver, F_GETFL) | O_NONBLOCK);
+	readBuffer.resize(1 << 16);
+
 	// some initial commands
 	// writeCommand("( set-option :print-success true )");
 	// writeCommand("( set-logic ALL )");
@@ -108,21 +131,13 @@ void SmtlibSmtSolver::add(std::string cmd) {
 
 SMTLIBSolverResult SmtlibSmtSolver::check() {
         // if (debug) CmdTraces.push_back("(check-sat)\n");
-	writeCommand("(check-sat)\n");
-	auto solverOutput = readSolverOutput();
-	auto errorRes = checkForErrorMessage(solverOutput);
-	if (errorRes != SMTLIBSolverResult::SMTRT_TBD) // unknown or error
-		return errorRes;
-
-	if (solverOutput.find("unsat") != std::string::npos) {
-		return SMTLIBSolverResult::SMTRT_Unsat;
-	} else {
-		// TODO: other cases?
-		return SMTLIBSolverResult::SMTRT_Sat;
-	}
+	startDeadline();
+	writeCommand("(check-sat)");
+	return readCheckSatResult();
 }
 
 void SmtlibSmtSolver::setLogic(std::string logic) {
+	this->logic = logic;
 	writeCommand("(set-logic " + logic + ")");
         // if (debug) CmdTraces.push_back("(set-logic " + logic + ")\n");
 }
@@ -143,80 +158,333 @@ void SmtlibSmtSolver::pop(unsigned num) {
 void SmtlibSmtSolver::reset() {
         // writeCommand("(reset-assertions)");
         writeCommand("(reset)");
+	// the scopes and the logic are cleared
+	contextLevel = 0;
+	logic.clear();
 }
 
 unsigned SmtlibSmtSolver::getContextLevel() const {
 	return contextLevel;
 }
 
+void SmtlibSmtSolver::restart(const std::string& reason) {
+	if (processIdOfSolver != 0) {
+		close(fromSolver);
+		close(toSolver);
+		kill(processIdOfSolver, SIGKILL);
+		waitpid(processIdOfSolver, nullptr, 0);
+		processIdOfSolver = 0;
+	}
+
+	// the partial output of the old process is dropped
+	readBegin = readEnd = scanPos = 0;
+	scanState = SS_Start;
+	scanDepth = 0;
+	contextLevel = 0;
+	generation++;
+
+	init();
+	if (!logic.empty()) {
+		writeCommand("(set-logic " + logic + ")");
+	}
+	reasonUnknown = reason;
+}
+
+void SmtlibSmtSolver::startDeadline() {
+	hasDeadline = SMTConfig::SMTLIBSolverTimeout > 0;
+	if (hasDeadline) {
+		deadline = std::chrono::steady_clock::now()
+				+ std::chrono::milliseconds(SMTConfig::SMTLIBSolverTimeout);
+	}
+}
+
+int SmtlibSmtSolver::remainingTime() const {
+	if (!hasDeadline) {
+		return -1;
+	}
+	auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+			deadline - std::chrono::steady_clock::now()).count();
+	return remaining > 0 ? (int) remaining : 0;
+}
+
+bool SmtlibSmtSolver::isRunning() {
+	if (processIdOfSolver == 0) {
+		return false;
+	}
+	if (waitpid(processIdOfSolver, nullptr, WNOHANG) == 0) {
+		return true;
+	}
+	close(fromSolver);
+	close(toSolver);
+	processIdOfSolver = 0;
+	return false;
+}
+
 SMTLIBSolverResult SmtlibSmtSolver::solveWholeFormula(std::string query) {
-        queries += 1;
+	sendWholeFormula(query);
+	return readCheckSatResult();
+}
 
+void SmtlibSmtSolver::sendWholeFormula(const std::string& query) {
+	startQuery();
 	writeCommand(query);
+}
+
+void SmtlibSmtSolver::startQuery() {
+        queries += 1;
+
+	// the deadline includes writing the query, which blocks
+	// if the solver does not read it
+	startDeadline();
+	reasonUnknown.clear();
+	pendingOutput.clear();
+}
+
+bool SmtlibSmtSolver::pollCheckSatResult(SMTLIBSolverResult& result) {
+	std::string response;
+	while (readResponse(response, false)) {
+		if (takeCheckSatResponse(response, result)) {
+			return true;
+		}
+	}
+	if (processIdOfSolver == 0 || (hasDeadline && remainingTime() == 0)) {
+		result = abandonQuery();
+		return true;
+	}
+	return false;
+}
+
+SMTLIBSolverResult SmtlibSmtSolver::readCheckSatResult() {
+	reasonUnknown.clear();
+	pendingOutput.clear();
+	std::string response;
+	SMTLIBSolverResult result;
+	while (readResponse(response)) {
+		if (takeCheckSatResponse(response, result)) {
+			return result;
+		}
+	}
+	return abandonQuery();
+}
 
-	auto solverOutput = readSolverOutput();
-	auto errorRes = checkForErrorMessage(solverOutput);
-        
-	if (errorRes != SMTLIBSolverResult::SMTRT_TBD) // unknown or error
-		return errorRes;
-	if (solverOutput.find("unsat") != std::string::npos) {
-		return SMTLIBSolverResult::SMTRT_Unsat;
+bool SmtlibSmtSolver::takeCheckSatResponse(const std::string& response, SMTLIBSolverResult& result) {
+	// The responses before the answer are errors (or the outputs of
+	// other commands), which are consumed to keep the stream in sync.
+	if (response == "sat") {
+		result = SMTLIBSolverResult::SMTRT_Sat;
+	} else if (response == "unsat") {
+		result = SMTLIBSolverResult::SMTRT_Unsat;
+	} else if (response == "unknown") {
+		result = SMTLIBSolverResult::SMTRT_Unknown;
+		reasonUnknown = "unknown";
 	} else {
-		// TODO: other cases?
-		return SMTLIBSolverResult::SMTRT_Sat;
+		pendingOutput += response + "\n";
+		return false;
+	}
+
+	hasDeadline = false;
+	if (!pendingOutput.empty()) {
+		auto errorRes = checkForErrorMessage(pendingOutput + response);
+		if (errorRes != SMTLIBSolverResult::SMTRT_TBD) // unknown or error
+			result = errorRes;
 	}
+	return true;
 }
 
-void SmtlibSmtSolver::writeCommand(std::string smt2Command) {
+SMTLIBSolverResult SmtlibSmtSolver::abandonQuery() {
+	// The solver has exited or missed the deadline. In the latter case it
+	// may never answer, and a late answer would be taken as the answer of
+	// the next query, so the process is replaced either way.
+	hasDeadline = false;
+	std::string reason;
 	if (processIdOfSolver != 0) {
-		if (write(toSolver, (smt2Command + "\n").c_str(),
-				smt2Command.length() + 1) < 0) {
-			assert("Was not able to write cmd");
-		}
+		reason = "timeout (" + std::to_string(SMTConfig::SMTLIBSolverTimeout) + " ms)";
+	} else {
+		reason = pendingOutput.empty() ? "the solver exited" : "the solver exited: " + pendingOutput.substr(0, 200);
 	}
+	// Deadline misses may be frequent, so the reason is only
+	// reported by getReasonUnknown(), not printed.
+	restart(reason);
+	return SMTLIBSolverResult::SMTRT_Unknown;
+}
+
+void SmtlibSmtSolver::writeCommand(const std::string& smt2Command) {
+	// the command and its newline, written by as few syscalls as possible
+	struct iovec parts[2];
+	parts[0].iov_base = (void*) smt2Command.data();
+	parts[0].iov_len = smt2Command.size();
+	parts[1].iov_base = (void*) "\n";
+	parts[1].iov_len = 1;
+	writeParts(parts, 2);
+}
+
+void SmtlibSmtSolver::writeData(const char* data, size_t size) {
+	struct iovec part;
+	part.iov_base = (void*) data;
+	part.iov_len = size;
+	writeParts(&part, 1);
 }
 
-std::string SmtlibSmtSolver::readSolverOutput(bool waitForOutput) {
+void SmtlibSmtSolver::writeParts(struct iovec* parts, int numParts) {
 	if (processIdOfSolver == 0) {
-		std::cout<< "failed to read solver output as the solver is not running\n";
-		return "error"; // is this OK?
+		return;
 	}
-	int bytesReadable;
-	if (waitForOutput) {
-		bytesReadable = 1;          // just assume that there are bytes readable
-	} else if (ioctl(fromSolver, FIONREAD, &bytesReadable) < 0) { // actually obtain the readable bytes
-		std::cout << "Could not check if the solver has output\n";
-		return "error"; // is this OK?
+
+	struct iovec* remaining = parts;
+	int numRemaining = numParts;
+
+	while (numRemaining > 0) {
+		ssize_t written = writev(toSolver, remaining, numRemaining);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				std::cout << "Was not able to write cmd: " << strerror(errno) << "\n";
+				return;
+			}
+
+			// The pipe is full. Keep reading the output meanwhile, since
+			// the solver may be blocked on writing it.
+			struct pollfd fds[2] = { { toSolver, POLLOUT, 0 }, { fromSolver, POLLIN, 0 } };
+			int ready = poll(fds, 2, remainingTime());
+			if (ready == 0 || (ready < 0 && errno != EINTR)) {
+				// the deadline has passed, which readCheckSatResult() handles
+				return;
+			}
+			if ((fds[1].revents & (POLLIN | POLLHUP)) && !fillReadBuffer()) {
+				return;
+			}
+			continue;
+		}
+
+		// skip the written parts, and the written prefix of a part
+		while (numRemaining > 0 && (size_t) written >= remaining->iov_len) {
+			written -= remaining->iov_len;
+			remaining++;
+			numRemaining--;
+		}
+		if (numRemaining > 0) {
+			remaining->iov_base = (char*) remaining->iov_base + written;
+			remaining->iov_len -= written;
+		}
 	}
-	std::string solverOutput = "";
-	const ssize_t MAX_CHUNK_SIZE = 256;
-	char chunk[MAX_CHUNK_SIZE];
-	while (bytesReadable > 0) {
-		ssize_t chunkSize = read(fromSolver, chunk, MAX_CHUNK_SIZE);
-		assert(chunkSize >= 0);
-		solverOutput += std::string(chunk, chunkSize);
-		if (ioctl(fromSolver, FIONREAD, &bytesReadable) < 0) { // obtain the new amount of readable bytes
-			std::cout << "Could not check if the solver has output\n";
-			return "error";
+}
+
+bool SmtlibSmtSolver::fillReadBuffer() {
+	if (readEnd == readBuffer.size()) {
+		if (readBegin > 0) {
+			std::memmove(readBuffer.data(), readBuffer.data() + readBegin, readEnd - readBegin);
+			scanPos -= readBegin;
+			readEnd -= readBegin;
+			readBegin = 0;
+		} else {
+			readBuffer.resize(readBuffer.size() * 2);
 		}
-		if (bytesReadable == 0 && solverOutput.back() != '\n') {
-			bytesReadable = 1;  // we expect more output!
+	}
+
+	while (true) {
+		ssize_t chunkSize = read(fromSolver, readBuffer.data() + readEnd, readBuffer.size() - readEnd);
+		if (chunkSize > 0) {
+			readEnd += chunkSize;
+			return true;
+		} else if (chunkSize < 0 && errno == EINTR) {
+			continue;
 		}
-		if (bytesReadable > 0) {
-			pid_t w = waitpid(processIdOfSolver, nullptr, WNOHANG);
-			if (w != 0) {
-				std::cout
-						<< "Error when checking whether the solver is still running. Will assume that solver has terminated.\n";
-				std::cout
-						<< "The solver exited unexpectedly when reading output: "
-						<< solverOutput << "\n";
-				solverOutput += "terminated";
-				this->processIdOfSolver = 0;
-				bytesReadable = 0;
+
+		// EOF, so the solver has exited or is about to
+		std::cout << "The solver exited unexpectedly when reading output\n";
+		kill(processIdOfSolver, SIGKILL);
+		waitpid(processIdOfSolver, nullptr, 0);
+		close(fromSolver);
+		close(toSolver);
+		processIdOfSolver = 0;
+		return false;
+	}
+}
+
+bool SmtlibSmtSolver::scanResponse(size_t& end) {
+	for (; scanPos < readEnd; scanPos++) {
+		char c = readBuffer[scanPos];
+		if (scanState == SS_Comment) {
+			if (c == '\n') {
+				scanState = scanDepth ? SS_List : SS_Start;
+				if (!scanDepth) {
+					readBegin = scanPos + 1;
+				}
 			}
+			continue;
+		} else if (scanState == SS_String) {
+			// "" in a string is an escaped quote, i.e. two toggles
+			if (c == '"') {
+				scanState = SS_List;
+			}
+			continue;
+		} else if (scanState == SS_QuotedSymbol) {
+			if (c == '|') {
+				scanState = scanDepth ? SS_List : SS_Atom;
+			}
+			continue;
 		}
+
+		bool space = c == ' ' || c == '\n' || c == '\t' || c == '\r';
+		if (scanState == SS_Start) {
+			if (space) {
+				readBegin = scanPos + 1;
+			} else if (c == ';') {
+				scanState = SS_Comment;
+			} else if (c == '(') {
+				scanState = SS_List;
+				scanDepth = 1;
+			} else {
+				scanState = c == '|' ? SS_QuotedSymbol : SS_Atom;
+			}
+		} else if (scanState == SS_Atom) {
+			if (space || c == '(' || c == ')') {
+				end = scanPos;
+				scanState = SS_Start;
+				return true;
+			} else if (c == '|') {
+				scanState = SS_QuotedSymbol;
+			}
+		} else if (c == '"') {
+			scanState = SS_String;
+		} else if (c == '|') {
+			scanState = SS_QuotedSymbol;
+		} else if (c == ';') {
+			scanState = SS_Comment;
+		} else if (c == '(') {
+			scanDepth++;
+		} else if (c == ')' && --scanDepth == 0) {
+			end = ++scanPos;
+			scanState = SS_Start;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SmtlibSmtSolver::readResponse(std::string& response, bool wait) {
+	size_t end;
+	while (!scanResponse(end)) {
+		if (processIdOfSolver == 0) {
+			return false;
+		}
+		struct pollfd fds = { fromSolver, POLLIN, 0 };
+		int ready = poll(&fds, 1, wait ? remainingTime() : 0);
+		if (ready == 0 || (ready < 0 && errno != EINTR)) {
+			return false;
+		}
+		if ((fds.revents & (POLLIN | POLLHUP | POLLERR)) && !fillReadBuffer()) {
+			return false;
+		}
+	}
+
+	response.assign(readBuffer.data() + readBegin, end - readBegin);
+	readBegin = end;
+	if (readBegin == readEnd) {
+		readBegin = readEnd = scanPos = 0;
 	}
-	return solverOutput;
+	return true;
 }
 
 SMTLIBSolverResult SmtlibSmtSolver::checkForErrorMessage(
@@ -229,14 +497,16 @@ SMTLIBSolverResult SmtlibSmtSolver::checkForErrorMessage(
 					<< "' and I am interpreting this as timeout\n";
 
 		}
-		this->processIdOfSolver = 0;
+		// the solver gave up by itself, so it can take the next query
+		reasonUnknown = "timeout";
 		return SMTLIBSolverResult::SMTRT_Unknown;
 	} else if (message.find("memory") != std::string::npos) {
 		if (debug) {
 			std::cout << "SMT solver answered: '" << message
 					<< "' and I am interpreting this as out of memory \n";
 		}
-		this->processIdOfSolver = 0;
+		// the process may be unusable, e.g. with its memory exhausted
+		restart("out of memory");
 		return SMTLIBSolverResult::SMTRT_Unknown;
 	} else if (message.find("error") != std::string::npos) {
 		if (debug) {
@@ -270,6 +540,7 @@ SMTLIBSolverResult SmtlibSmtSolver::checkForErrorMessage(
 			std::cout << errorMsg << "\n";
 		}
 
+		reasonUnknown = "error";
 		return SMTLIBSolverResult::SMTRT_Error;
 	}
 
@@ -281,7 +552,7 @@ SMTLIBSolverResult SmtlibSmtSolver::checkForErrorMessage(
 // TODO: allow more options
 SmtlibSmtSolver* createSMTLIBSolver() {
   	SmtlibSmtSolver* BinSolver = new SmtlibSmtSolver(SMTConfig::SMTLIBSolverPath, SMTConfig::SMTLIBSolverArgs);
-	BinSolver->setLogic("QF_BV");
+	// the logic is set by the client, which knows the assertions
 	//gs->set_timeout(1);
 	return BinSolver;
 }
@@ -0,0 +1,146 @@
+/**
+ * A pool of warm external SMTLIB solver processes.
+ */
+
+#include <llvm/Support/CommandLine.h>
+
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+#include "SMT/SMTLIBSolverPool.h"
+#include "SMT/SMTConfigure.h"
+
+static llvm::cl::opt<unsigned> SMTLIBPoolSize("smtlib-pool-size", llvm::cl::init(0),
+        llvm::cl::desc("Keep this number of idle SMTLIB solver processes for the non-incremental SMTLIB solver, "
+                "which are reused by (reset) between queries. 0 means starting a process per query."));
+
+static llvm::cl::opt<unsigned> SMTLIBPoolMaxQueries("smtlib-pool-max-queries", llvm::cl::init(1000),
+        llvm::cl::desc("Replace a pooled SMTLIB solver process after this number of queries. 0 means no limit."));
+
+static llvm::cl::opt<unsigned> SMTLIBPoolMaxRSS("smtlib-pool-max-rss-mb", llvm::cl::init(1024),
+        llvm::cl::desc("Replace a pooled SMTLIB solver process whose resident memory exceeds this size (MB). "
+                "0 means no limit."));
+
+/// The resident memory of a process in bytes, or 0 if it is unknown.
+static uint64_t residentSetSize(pid_t Pid) {
+	std::string Path = "/proc/" + std::to_string(Pid) + "/statm";
+	FILE* Statm = fopen(Path.c_str(), "r");
+	if (!Statm) {
+		return 0;
+	}
+	unsigned long Size = 0, Resident = 0;
+	int Read = fscanf(Statm, "%lu %lu", &Size, &Resident);
+	fclose(Statm);
+	return Read == 2 ? (uint64_t) Resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+SMTLIBSolverPool::Lease::~Lease() {
+	if (Solver) {
+		Pool->checkin(Solver);
+	}
+}
+
+SMTLIBSolverPool& SMTLIBSolverPool::get() {
+	static SMTLIBSolverPool Pool;
+	return Pool;
+}
+
+SMTLIBSolverPool::SMTLIBSolverPool() {
+	for (unsigned I = 0; I < SMTLIBPoolSize.getValue(); I++) {
+		Idle.push_back(start());
+	}
+}
+
+SMTLIBSolverPool::~SMTLIBSolverPool() {
+	for (SmtlibSmtSolver* Solver : Idle) {
+		delete Solver;
+	}
+}
+
+SmtlibSmtSolver* SMTLIBSolverPool::start() {
+	{
+		std::lock_guard<std::mutex> L(PoolLock);
+		Stats.Started++;
+	}
+	return new SmtlibSmtSolver(SMTConfig::SMTLIBSolverPath, SMTConfig::SMTLIBSolverArgs);
+}
+
+SMTLIBSolverPool::Lease SMTLIBSolverPool::checkout() {
+	while (true) {
+		SmtlibSmtSolver* Solver = nullptr;
+		{
+			std::lock_guard<std::mutex> L(PoolLock);
+			if (!Idle.empty()) {
+				Solver = Idle.back();
+				Idle.pop_back();
+			}
+		}
+		if (!Solver) {
+			return Lease(this, start());
+		}
+
+		// the process may have exited while it is idle
+		if (Solver->isRunning()) {
+			std::lock_guard<std::mutex> L(PoolLock);
+			Stats.Reused++;
+			return Lease(this, Solver);
+		}
+		delete Solver;
+		std::lock_guard<std::mutex> L(PoolLock);
+		Stats.Dead++;
+	}
+}
+
+bool SMTLIBSolverPool::reusable(SmtlibSmtSolver* Solver) {
+	if (!Solver->isRunning()) {
+		std::lock_guard<std::mutex> L(PoolLock);
+		Stats.Dead++;
+		return false;
+	}
+
+	if ((SMTLIBPoolMaxQueries.getValue() && (unsigned) Solver->queries >= SMTLIBPoolMaxQueries.getValue())
+			|| (SMTLIBPoolMaxRSS.getValue()
+					&& residentSetSize(Solver->processIdOfSolver) > (uint64_t) SMTLIBPoolMaxRSS.getValue() << 20)) {
+		std::lock_guard<std::mutex> L(PoolLock);
+		Stats.Recycled++;
+		return false;
+	}
+	return true;
+}
+
+void SMTLIBSolverPool::checkin(SmtlibSmtSolver* Solver) {
+	if (SMTLIBPoolSize.getValue() == 0) {
+		// a process per query
+		delete Solver;
+		return;
+	}
+
+	if (reusable(Solver)) {
+		// clear the query for the next one
+		Solver->reset();
+	} else {
+		delete Solver;
+		Solver = nullptr;
+	}
+
+	std::unique_lock<std::mutex> L(PoolLock);
+	if (Idle.size() >= SMTLIBPoolSize.getValue()) {
+		// an extra solver started when no solver was idle
+		L.unlock();
+		delete Solver;
+		return;
+	}
+	if (!Solver) {
+		// keep the pool warm
+		L.unlock();
+		Solver = start();
+		L.lock();
+	}
+	Idle.push_back(Solver);
+}
+
+SMTLIBSolverPool::Statistics SMTLIBSolverPool::getStatistics() {
+	std::lock_guard<std::mutex> L(PoolLock);
+	return Stats;
+}
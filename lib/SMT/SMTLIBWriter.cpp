@@ -0,0 +1,424 @@
+/**
+ * An incremental SMT-LIB2 writer of z3 expressions.
+ */
+
+#include <cctype>
+#include <cstring>
+#include <cassert>
+#include <errno.h>
+#include <unistd.h>
+#include <unordered_set>
+
+#include "SMT/SMTLIBWriter.h"
+
+/// The text is passed to the sink in chunks of about this size.
+static const size_t ChunkSize = 1 << 16;
+
+/// The SMT-LIB name of an operator without indices, or nullptr if the
+/// operator is not known to the writer. z3's variants of the division
+/// operators (e.g. bvudiv_i) are printed as the standard ones.
+static const char* operatorName(Z3_decl_kind Kind) {
+	switch (Kind) {
+	case Z3_OP_EQ: return "=";
+	case Z3_OP_IFF: return "=";
+	case Z3_OP_DISTINCT: return "distinct";
+	case Z3_OP_ITE: return "ite";
+	case Z3_OP_AND: return "and";
+	case Z3_OP_OR: return "or";
+	case Z3_OP_XOR: return "xor";
+	case Z3_OP_NOT: return "not";
+	case Z3_OP_IMPLIES: return "=>";
+	case Z3_OP_BNEG: return "bvneg";
+	case Z3_OP_BADD: return "bvadd";
+	case Z3_OP_BSUB: return "bvsub";
+	case Z3_OP_BMUL: return "bvmul";
+	case Z3_OP_BSDIV: case Z3_OP_BSDIV_I: return "bvsdiv";
+	case Z3_OP_BUDIV: case Z3_OP_BUDIV_I: return "bvudiv";
+	case Z3_OP_BSREM: case Z3_OP_BSREM_I: return "bvsrem";
+	case Z3_OP_BUREM: case Z3_OP_BUREM_I: return "bvurem";
+	case Z3_OP_BSMOD: case Z3_OP_BSMOD_I: return "bvsmod";
+	case Z3_OP_ULEQ: return "bvule";
+	case Z3_OP_SLEQ: return "bvsle";
+	case Z3_OP_UGEQ: return "bvuge";
+	case Z3_OP_SGEQ: return "bvsge";
+	case Z3_OP_ULT: return "bvult";
+	case Z3_OP_SLT: return "bvslt";
+	case Z3_OP_UGT: return "bvugt";
+	case Z3_OP_SGT: return "bvsgt";
+	case Z3_OP_BAND: return "bvand";
+	case Z3_OP_BOR: return "bvor";
+	case Z3_OP_BNOT: return "bvnot";
+	case Z3_OP_BXOR: return "bvxor";
+	case Z3_OP_BNAND: return "bvnand";
+	case Z3_OP_BNOR: return "bvnor";
+	case Z3_OP_BXNOR: return "bvxnor";
+	case Z3_OP_CONCAT: return "concat";
+	case Z3_OP_BCOMP: return "bvcomp";
+	case Z3_OP_BSHL: return "bvshl";
+	case Z3_OP_BLSHR: return "bvlshr";
+	case Z3_OP_BASHR: return "bvashr";
+	case Z3_OP_SELECT: return "select";
+	case Z3_OP_STORE: return "store";
+	default: return nullptr;
+	}
+}
+
+/// The SMT-LIB name of an indexed operator, or nullptr.
+static const char* indexedOperatorName(Z3_decl_kind Kind) {
+	switch (Kind) {
+	case Z3_OP_EXTRACT: return "extract";
+	case Z3_OP_SIGN_EXT: return "sign_extend";
+	case Z3_OP_ZERO_EXT: return "zero_extend";
+	case Z3_OP_REPEAT: return "repeat";
+	case Z3_OP_ROTATE_LEFT: return "rotate_left";
+	case Z3_OP_ROTATE_RIGHT: return "rotate_right";
+	default: return nullptr;
+	}
+}
+
+static std::string symbolName(Z3_context Ctx, Z3_symbol Symbol) {
+	std::string Name = Z3_get_symbol_kind(Ctx, Symbol) == Z3_INT_SYMBOL
+			? "k!" + std::to_string(Z3_get_symbol_int(Ctx, Symbol)) : Z3_get_symbol_string(Ctx, Symbol);
+	bool Simple = !Name.empty() && !isdigit((unsigned char) Name[0]);
+	for (char C : Name) {
+		if (!isalnum((unsigned char) C) && !strchr("~!@$%^&*_-+=<>.?/", C)) {
+			Simple = false;
+			break;
+		}
+	}
+	if (Simple) {
+		return Name;
+	}
+
+	// A quoted symbol of SMT-LIB cannot contain '|' or a backslash. Such
+	// names are quoted as z3 prints them (Z3_ast_to_string), escaping both
+	// by a backslash, so that they match the subterms printed by z3.
+	std::string Quoted = "|";
+	for (char C : Name) {
+		if (C == '|' || C == '\\') {
+			Quoted += '\\';
+		}
+		Quoted += C;
+	}
+	return Quoted + "|";
+}
+
+SMTLIBWriter::SMTLIBWriter(Sink S) : Out(S), Scopes(1) {
+	Buffer.reserve(ChunkSize + 256);
+}
+
+SMTLIBWriter::SMTLIBWriter(std::string& O) : SMTLIBWriter([&O](const char* Data, size_t Size) {
+	O.append(Data, Size);
+}) {
+}
+
+SMTLIBWriter::SMTLIBWriter(std::ostream& O) : SMTLIBWriter([&O](const char* Data, size_t Size) {
+	O.write(Data, Size);
+}) {
+}
+
+SMTLIBWriter::SMTLIBWriter(int Fd) : SMTLIBWriter([Fd](const char* Data, size_t Size) {
+	while (Size > 0) {
+		ssize_t Written = ::write(Fd, Data, Size);
+		if (Written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		Data += Written;
+		Size -= Written;
+	}
+}) {
+}
+
+SMTLIBWriter::~SMTLIBWriter() {
+	flush();
+}
+
+void SMTLIBWriter::add(const z3::expr& E) {
+	write(std::vector<z3::expr>(1, E));
+}
+
+void SMTLIBWriter::addAll(const z3::expr_vector& Es) {
+	std::vector<z3::expr> Batch;
+	for (unsigned I = 0; I < Es.size(); I++) {
+		Batch.push_back(Es[I]);
+	}
+	write(Batch);
+}
+
+void SMTLIBWriter::addAll(std::vector<z3::expr>::const_iterator Begin, std::vector<z3::expr>::const_iterator End) {
+	write(std::vector<z3::expr>(Begin, End));
+}
+
+void SMTLIBWriter::command(const std::string& Cmd) {
+	put(Cmd);
+	put('\n');
+}
+
+void SMTLIBWriter::push() {
+	Scopes.emplace_back();
+}
+
+void SMTLIBWriter::pop(unsigned N) {
+	assert(N < Scopes.size());
+	for (unsigned I = 0; I < N; I++) {
+		for (unsigned Id : Scopes.back().Declared) {
+			Declared.erase(Id);
+		}
+		for (unsigned Id : Scopes.back().Defined) {
+			Defined.erase(Id);
+		}
+		Scopes.pop_back();
+	}
+}
+
+void SMTLIBWriter::reset() {
+	Declared.clear();
+	Defined.clear();
+	Scopes.assign(1, Scope());
+}
+
+void SMTLIBWriter::flush() {
+	if (!Buffer.empty()) {
+		Out(Buffer.data(), Buffer.size());
+		Buffer.clear();
+	}
+}
+
+void SMTLIBWriter::put(const char* Data, size_t Size) {
+	Buffer.append(Data, Size);
+	Stats.Bytes += Size;
+	if (Buffer.size() >= ChunkSize) {
+		flush();
+	}
+}
+
+void SMTLIBWriter::put(char C) {
+	Buffer.push_back(C);
+	Stats.Bytes++;
+	if (Buffer.size() >= ChunkSize) {
+		flush();
+	}
+}
+
+void SMTLIBWriter::write(const std::vector<z3::expr>& Batch) {
+	if (Batch.empty()) {
+		return;
+	}
+	z3::context& Ctx = Batch.front().ctx();
+
+	// 1. Count the references to the new subterms, and declare the new
+	// symbols. The subterms whose arguments are printed by the writer
+	// are collected in post order, i.e. after their arguments.
+	std::unordered_map<unsigned, unsigned> References;
+	std::vector<Z3_ast> PostOrder;
+	// <subterm, if its arguments are visited>
+	std::vector<std::pair<Z3_ast, bool>> Stack;
+	for (auto It = Batch.rbegin(); It != Batch.rend(); ++It) {
+		Stack.push_back(std::make_pair((Z3_ast) *It, false));
+	}
+	while (!Stack.empty()) {
+		Z3_ast Node = Stack.back().first;
+		bool Visited = Stack.back().second;
+		Stack.pop_back();
+		if (Visited) {
+			PostOrder.push_back(Node);
+			continue;
+		}
+
+		unsigned Id = Z3_get_ast_id(Ctx, Node);
+		if (Defined.count(Id) || ++References[Id] > 1) {
+			continue;
+		}
+		if (!Z3_is_app(Ctx, Node) || !printable(Ctx, Z3_to_app(Ctx, Node))) {
+			declareAll(Ctx, Node);
+			continue;
+		}
+		Z3_app App = Z3_to_app(Ctx, Node);
+		declare(Ctx, App);
+		unsigned NumArgs = Z3_get_app_num_args(Ctx, App);
+		if (NumArgs == 0) {
+			continue;
+		}
+		Stack.push_back(std::make_pair(Node, true));
+		for (unsigned I = NumArgs; I-- > 0;) {
+			Stack.push_back(std::make_pair(Z3_get_app_arg(Ctx, App, I), false));
+		}
+	}
+
+	// 2. define the subterms referred to more than once
+	for (Z3_ast Node : PostOrder) {
+		unsigned Id = Z3_get_ast_id(Ctx, Node);
+		if (References[Id] < 2) {
+			continue;
+		}
+		std::string Name = "_sh!" + std::to_string(Id);
+		put("(define-fun " + Name + " () " + sortName(Ctx, Z3_get_sort(Ctx, Node)) + " ");
+		printTerm(Ctx, Node);
+		put(")\n");
+		Defined.insert(std::make_pair(Id, std::make_pair(z3::expr(Ctx, Node), Name)));
+		Scopes.back().Defined.push_back(Id);
+		Stats.Definitions++;
+	}
+
+	// 3. the assertions
+	for (auto& E : Batch) {
+		put("(assert ");
+		printTerm(Ctx, E);
+		put(")\n");
+		Stats.Assertions++;
+	}
+}
+
+void SMTLIBWriter::declare(z3::context& Ctx, Z3_app App) {
+	Z3_func_decl Decl = Z3_get_app_decl(Ctx, App);
+	if (Z3_get_decl_kind(Ctx, Decl) != Z3_OP_UNINTERPRETED) {
+		return;
+	}
+	unsigned Id = Z3_get_func_decl_id(Ctx, Decl);
+	if (Declared.count(Id)) {
+		return;
+	}
+
+	std::string Name = symbolName(Ctx, Z3_get_decl_name(Ctx, Decl));
+	put("(declare-fun " + Name + " (");
+	for (unsigned I = 0, E = Z3_get_domain_size(Ctx, Decl); I < E; I++) {
+		if (I) {
+			put(' ');
+		}
+		put(sortName(Ctx, Z3_get_domain(Ctx, Decl, I)));
+	}
+	put(") ");
+	put(sortName(Ctx, Z3_get_range(Ctx, Decl)));
+	put(")\n");
+
+	Declared.insert(std::make_pair(Id, std::make_pair(z3::func_decl(Ctx, Decl), Name)));
+	Scopes.back().Declared.push_back(Id);
+	Stats.Declarations++;
+}
+
+const std::string& SMTLIBWriter::sortName(z3::context& Ctx, Z3_sort Sort) {
+	// printing a sort by z3 is slow
+	unsigned Id = Z3_get_sort_id(Ctx, Sort);
+	auto It = SortNames.find(Id);
+	if (It == SortNames.end()) {
+		It = SortNames.insert(std::make_pair(Id, std::make_pair(z3::sort(Ctx, Sort), Z3_sort_to_string(Ctx, Sort)))).first;
+	}
+	return It->second.second;
+}
+
+void SMTLIBWriter::declareAll(z3::context& Ctx, Z3_ast Root) {
+	std::unordered_set<unsigned> Visited;
+	std::vector<Z3_ast> Worklist(1, Root);
+	while (!Worklist.empty()) {
+		Z3_ast Node = Worklist.back();
+		Worklist.pop_back();
+		if (!Visited.insert(Z3_get_ast_id(Ctx, Node)).second) {
+			continue;
+		}
+		if (Z3_get_ast_kind(Ctx, Node) == Z3_QUANTIFIER_AST) {
+			Worklist.push_back(Z3_get_quantifier_body(Ctx, Node));
+		} else if (Z3_is_app(Ctx, Node)) {
+			Z3_app App = Z3_to_app(Ctx, Node);
+			declare(Ctx, App);
+			for (unsigned I = 0, E = Z3_get_app_num_args(Ctx, App); I < E; I++) {
+				Worklist.push_back(Z3_get_app_arg(Ctx, App, I));
+			}
+		}
+	}
+}
+
+bool SMTLIBWriter::printable(z3::context& Ctx, Z3_app App) {
+	Z3_decl_kind Kind = Z3_get_decl_kind(Ctx, Z3_get_app_decl(Ctx, App));
+	return Kind == Z3_OP_UNINTERPRETED || Kind == Z3_OP_BNUM || Kind == Z3_OP_TRUE || Kind == Z3_OP_FALSE
+			|| operatorName(Kind) || indexedOperatorName(Kind);
+}
+
+void SMTLIBWriter::printTerm(z3::context& Ctx, Z3_ast Root) {
+	// <subterm, the number of its arguments, the next argument to print>
+	struct Frame {
+		Z3_app App;
+		unsigned NumArgs;
+		unsigned Next;
+	};
+	std::vector<Frame> Stack;
+	if (unsigned NumArgs = printOpen(Ctx, Root)) {
+		Stack.push_back(Frame{Z3_to_app(Ctx, Root), NumArgs, 0});
+	}
+	while (!Stack.empty()) {
+		Frame& F = Stack.back();
+		if (F.Next == F.NumArgs) {
+			put(')');
+			Stack.pop_back();
+			continue;
+		}
+		Z3_ast Arg = Z3_get_app_arg(Ctx, F.App, F.Next++);
+		put(' ');
+		if (unsigned NumArgs = printOpen(Ctx, Arg)) {
+			Stack.push_back(Frame{Z3_to_app(Ctx, Arg), NumArgs, 0});
+		}
+	}
+}
+
+unsigned SMTLIBWriter::printOpen(z3::context& Ctx, Z3_ast Node) {
+	auto It = Defined.find(Z3_get_ast_id(Ctx, Node));
+	if (It != Defined.end()) {
+		put(It->second.second);
+		return 0;
+	}
+	if (!Z3_is_app(Ctx, Node) || !printable(Ctx, Z3_to_app(Ctx, Node))) {
+		put(Z3_ast_to_string(Ctx, Node));
+		Stats.Fallbacks++;
+		return 0;
+	}
+
+	Z3_app App = Z3_to_app(Ctx, Node);
+	Z3_func_decl Decl = Z3_get_app_decl(Ctx, App);
+	Z3_decl_kind Kind = Z3_get_decl_kind(Ctx, Decl);
+	unsigned NumArgs = Z3_get_app_num_args(Ctx, App);
+	if (Kind == Z3_OP_BNUM) {
+		unsigned Width = Z3_get_bv_sort_size(Ctx, Z3_get_sort(Ctx, Node));
+		std::string Bits = Z3_get_numeral_binary_string(Ctx, Node);
+		if (Bits.size() < Width) {
+			Bits.insert(0, Width - Bits.size(), '0');
+		}
+		if (Width % 4) {
+			put("#b" + Bits);
+		} else {
+			std::string Hex = "#x";
+			for (size_t I = 0; I < Bits.size(); I += 4) {
+				int Digit = (Bits[I] - '0') * 8 + (Bits[I + 1] - '0') * 4 + (Bits[I + 2] - '0') * 2 + (Bits[I + 3] - '0');
+				Hex += "0123456789abcdef"[Digit];
+			}
+			put(Hex);
+		}
+		return 0;
+	} else if (Kind == Z3_OP_TRUE || Kind == Z3_OP_FALSE) {
+		put(Kind == Z3_OP_TRUE ? "true" : "false");
+		return 0;
+	} else if (Kind == Z3_OP_UNINTERPRETED) {
+		const std::string& Name = Declared.find(Z3_get_func_decl_id(Ctx, Decl))->second.second;
+		if (NumArgs == 0) {
+			put(Name);
+			return 0;
+		}
+		put('(');
+		put(Name);
+		return NumArgs;
+	}
+
+	put('(');
+	if (const char* Name = operatorName(Kind)) {
+		put(Name, strlen(Name));
+	} else {
+		put("(_ ");
+		put(indexedOperatorName(Kind));
+		for (unsigned I = 0, E = Z3_get_decl_num_parameters(Ctx, Decl); I < E; I++) {
+			put(" " + std::to_string(Z3_get_decl_int_parameter(Ctx, Decl, I)));
+		}
+		put(')');
+	}
+	return NumArgs;
+}
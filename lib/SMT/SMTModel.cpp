@@ -4,7 +4,10 @@
 
 #include "SMT/SMTModel.h"
 #include "SMT/SMTFactory.h"
+#include "SMT/SMTExpr.h"
 
+#include <cstring>
+#include <iostream>
 #include <sstream>
 
 SMTModel::SMTModel(SMTFactory* F, z3::model Z3Model) : SMTObject(F),
@@ -46,3 +49,116 @@ std::pair<std::string, std::string> SMTModel::getModelDbgInfo(int Index) {
 		return std::pair<std::string, std::string>("", "");
 	}
 }
+
+/// Append the words of \p Value, a bool or bit-vector numeral, to
+/// \p Words. Returns false if it is not such a numeral.
+static bool appendWords(const z3::expr& Value, std::vector<uint64_t>& Words) {
+	Z3_context Ctx = Value.ctx();
+	if (Value.is_bool()) {
+		Z3_lbool B = Z3_get_bool_value(Ctx, Value);
+		Words.push_back(B == Z3_L_TRUE ? 1 : 0);
+		return B != Z3_L_UNDEF;
+	} else if (!Value.is_bv()) {
+		return false;
+	}
+
+	unsigned Width = Value.get_sort().bv_size();
+	size_t First = Words.size();
+	Words.resize(First + (Width + 63) / 64, 0);
+	if (!Value.is_numeral()) {
+		return false;
+	}
+
+	uint64_t U;
+	if (Width <= 64 && Z3_get_numeral_uint64(Ctx, Value, &U)) {
+		Words[First] = U;
+		return true;
+	}
+
+	// wider than 64 bits; the string has no leading zeros
+	Z3_string Binary = Z3_get_numeral_binary_string(Ctx, Value);
+	size_t Len = strlen(Binary);
+	for (size_t I = 0; I < Len && I < Width; I++) {
+		if (Binary[Len - 1 - I] == '1') {
+			Words[First + I / 64] |= (uint64_t) 1 << (I % 64);
+		}
+	}
+	return true;
+}
+
+bool SMTModel::evalUint64(const SMTExprVec& Exprs, std::vector<uint64_t>& Values) {
+	Values.assign(Exprs.size(), 0);
+	bool Ret = true;
+	try {
+		for (unsigned I = 0; I < Exprs.size(); I++) {
+			z3::expr Value = Model.eval((*Exprs.ExprVec)[I], true);
+			uint64_t U;
+			if (Value.is_bool() && Z3_get_bool_value(Value.ctx(), Value) != Z3_L_UNDEF) {
+				Values[I] = Value.is_true() ? 1 : 0;
+			} else if (Value.is_bv() && Value.get_sort().bv_size() <= 64 && Value.is_numeral()
+					&& Z3_get_numeral_uint64(Value.ctx(), Value, &U)) {
+				Values[I] = U;
+			} else {
+				Ret = false;
+			}
+		}
+	} catch (z3::exception &Ex) {
+		std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+		return false;
+	}
+	return Ret;
+}
+
+bool SMTModel::evalWords(const SMTExprVec& Exprs, std::vector<uint64_t>& Words, std::vector<size_t>& Offsets) {
+	Words.clear();
+	Offsets.assign(1, 0);
+	bool Ret = true;
+	try {
+		for (unsigned I = 0; I < Exprs.size(); I++) {
+			Ret = appendWords(Model.eval((*Exprs.ExprVec)[I], true), Words) && Ret;
+			Offsets.push_back(Words.size());
+		}
+	} catch (z3::exception &Ex) {
+		std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+		Offsets.resize(Exprs.size() + 1, Words.size());
+		return false;
+	}
+	return Ret;
+}
+
+SMTModel SMTModel::project(const SMTExprVec& Vars) {
+	z3::model Projected(Model.ctx());
+	for (unsigned I = 0; I < Vars.size(); I++) {
+		z3::expr Var = (*Vars.ExprVec)[I];
+		if (!Var.is_const() || Var.is_numeral()) {
+			continue;
+		}
+		z3::func_decl Decl = Var.decl();
+		if (Model.has_interp(Decl)) {
+			z3::expr Value = Model.get_const_interp(Decl);
+			Projected.add_const_interp(Decl, Value);
+		}
+	}
+	return SMTModel(&getSMTFactory(), Projected);
+}
+
+SMTExprVec SMTModel::getConstants() {
+	SMTExprVec Ret = getSMTFactory().createEmptySMTExprVec();
+	for (unsigned I = 0, N = Model.num_consts(); I < N; I++) {
+		Ret.push_back(SMTExpr(&getSMTFactory(), Model.get_const_decl(I)()), true);
+	}
+	return Ret;
+}
+
+void SMTModel::getAssignment(std::vector<uint64_t>& Words, std::vector<size_t>& Offsets) {
+	Words.clear();
+	Offsets.assign(1, 0);
+	for (unsigned I = 0, N = Model.num_consts(); I < N; I++) {
+		z3::expr Value = Model.get_const_interp(Model.get_const_decl(I));
+		if (!appendWords(Value, Words)) {
+			// e.g. an array
+			Words.resize(Offsets.back());
+		}
+		Offsets.push_back(Words.size());
+	}
+}
@@ -0,0 +1,63 @@
+/**
+ * A pool of recent models for answering sat queries without solving.
+ */
+
+#include <chrono>
+
+#include "SMT/SMTModelPool.h"
+
+/// A copy of \p Model, which does not change with it.
+static std::shared_ptr<z3::model> copyOf(const z3::model& Model) {
+	z3::context& Ctx = Model.ctx();
+	return std::make_shared<z3::model>(Ctx, Z3_model_translate(Ctx, Model, Ctx));
+}
+
+SMTModelPool::SMTModelPool(size_t Cap) : Capacity(Cap) {
+}
+
+std::shared_ptr<z3::model> SMTModelPool::findModelOf(const z3::expr_vector& Assertions) {
+	if (!enabled() || Models.empty()) {
+		return nullptr;
+	}
+
+	auto Start = std::chrono::steady_clock::now();
+	Stats.Attempts++;
+
+	std::shared_ptr<z3::model> Ret;
+	for (auto It = Models.begin(), E = Models.end(); It != E; ++It) {
+		z3::model& Model = **It;
+		bool Satisfied = true;
+		for (unsigned I = 0, N = Assertions.size(); I < N && Satisfied; I++) {
+			// with model completion, unconstrained symbols get default values
+			Satisfied = Model.eval(Assertions[I], true).is_true();
+		}
+
+		if (Satisfied) {
+			// The model completion adds interpretations to the pooled
+			// model, so the callers get a copy, which later queries do
+			// not change.
+			Ret = copyOf(Model);
+			std::shared_ptr<z3::model> Pooled = *It;
+			Models.erase(It);
+			Models.push_front(Pooled);
+			Stats.Reuses++;
+			break;
+		}
+	}
+
+	auto Time = std::chrono::steady_clock::now() - Start;
+	Stats.PreCheckTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(Time).count();
+	return Ret;
+}
+
+void SMTModelPool::insert(const z3::model& Model) {
+	if (!enabled()) {
+		return;
+	}
+
+	// the caller may keep using Model, e.g. as the model of its solver
+	Models.push_front(copyOf(Model));
+	while (Models.size() > Capacity) {
+		Models.pop_back();
+	}
+}
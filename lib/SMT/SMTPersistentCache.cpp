@@ -0,0 +1,189 @@
+/**
+ * A persistent query result cache shared between processes and runs.
+ */
+
+#include <llvm/Support/CommandLine.h>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+#include "SMT/SMTPersistentCache.h"
+
+static llvm::cl::opt<std::string> PersistentCachePath("solver-persistent-cache", llvm::cl::init(""),
+        llvm::cl::desc("Record query results in this file and reuse them in later runs or in concurrent processes."));
+
+static llvm::cl::opt<unsigned> PersistentCacheSlots("solver-persistent-cache-slots", llvm::cl::init(1 << 20),
+        llvm::cl::desc("The number of slots when creating the file of -solver-persistent-cache (32 bytes per slot)."));
+
+#define PCACHE_MAGIC "SMTQCACH"
+#define PCACHE_VERSION 1
+#define PCACHE_MAX_PROBE 64
+
+enum SlotState : uint32_t {
+	SS_Empty = 0, SS_Writing = 1, SS_Ready = 2
+};
+
+struct SMTPersistentCache::Header {
+	char Magic[8];
+	uint32_t Version;
+	uint32_t SlotSize;
+	uint64_t NumSlots;
+	uint64_t NumEntries;
+};
+
+struct SMTPersistentCache::Slot {
+	uint32_t State;
+	uint32_t Result;
+	uint64_t KeyHi;
+	uint64_t KeyLo;
+	uint64_t SolveTimeUs;
+};
+
+SMTPersistentCache* SMTPersistentCache::get() {
+	// opened once per process, thread-safe since C++11
+	static SMTPersistentCache* Cache = PersistentCachePath.empty() ? nullptr
+			: open(PersistentCachePath.getValue(), PersistentCacheSlots.getValue());
+	return Cache;
+}
+
+SMTPersistentCache* SMTPersistentCache::open(const std::string& Path, uint64_t NumSlots) {
+	int FD = ::open(Path.c_str(), O_RDWR | O_CREAT, 0666);
+	if (FD < 0) {
+		std::cerr << "Persistent cache cannot be opened: " << Path << ": " << strerror(errno) << "\n";
+		return nullptr;
+	}
+
+	// The first process initializes the file. Others wait for it.
+	if (flock(FD, LOCK_EX) != 0) {
+		std::cerr << "Persistent cache cannot be locked: " << Path << ": " << strerror(errno) << "\n";
+		close(FD);
+		return nullptr;
+	}
+
+	struct stat St;
+	if (fstat(FD, &St) != 0) {
+		flock(FD, LOCK_UN);
+		close(FD);
+		return nullptr;
+	}
+
+	size_t MappedSize;
+	if (St.st_size == 0) {
+		if (NumSlots == 0) {
+			NumSlots = 1;
+		}
+		MappedSize = sizeof(Header) + NumSlots * sizeof(Slot);
+		Header Head;
+		memset(&Head, 0, sizeof(Head));
+		memcpy(Head.Magic, PCACHE_MAGIC, sizeof(Head.Magic));
+		Head.Version = PCACHE_VERSION;
+		Head.SlotSize = sizeof(Slot);
+		Head.NumSlots = NumSlots;
+		// ftruncate fills the slots with zeros, i.e., SS_Empty
+		if (ftruncate(FD, MappedSize) != 0 || pwrite(FD, &Head, sizeof(Head), 0) != (ssize_t) sizeof(Head)) {
+			std::cerr << "Persistent cache cannot be initialized: " << Path << ": " << strerror(errno) << "\n";
+			flock(FD, LOCK_UN);
+			close(FD);
+			return nullptr;
+		}
+	} else {
+		Header Head;
+		if (pread(FD, &Head, sizeof(Head), 0) != (ssize_t) sizeof(Head)
+				|| memcmp(Head.Magic, PCACHE_MAGIC, sizeof(Head.Magic)) != 0
+				|| Head.Version != PCACHE_VERSION || Head.SlotSize != sizeof(Slot)
+				|| (uint64_t) St.st_size != sizeof(Header) + Head.NumSlots * sizeof(Slot)) {
+			std::cerr << "Persistent cache has an incompatible format: " << Path << "\n";
+			flock(FD, LOCK_UN);
+			close(FD);
+			return nullptr;
+		}
+		MappedSize = St.st_size;
+	}
+	flock(FD, LOCK_UN);
+
+	void* Mapped = mmap(nullptr, MappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, FD, 0);
+	if (Mapped == MAP_FAILED) {
+		std::cerr << "Persistent cache cannot be mapped: " << Path << ": " << strerror(errno) << "\n";
+		close(FD);
+		return nullptr;
+	}
+	return new SMTPersistentCache(FD, MappedSize, Mapped);
+}
+
+SMTPersistentCache::SMTPersistentCache(int FD, size_t MappedSize, void* Mapped) :
+		FD(FD), MappedSize(MappedSize), Head((Header*) Mapped),
+		Slots((Slot*) ((char*) Mapped + sizeof(Header))) {
+}
+
+SMTPersistentCache::~SMTPersistentCache() {
+	munmap(Head, MappedSize);
+	close(FD);
+}
+
+uint64_t SMTPersistentCache::size() const {
+	return __atomic_load_n(&Head->NumEntries, __ATOMIC_RELAXED);
+}
+
+uint64_t SMTPersistentCache::capacity() const {
+	return Head->NumSlots;
+}
+
+bool SMTPersistentCache::lookup(const SMTFingerprint& Key, SMTSolver::SMTResultType& Result, uint64_t& SolveTimeUs) {
+	uint64_t NumSlots = Head->NumSlots;
+	for (uint64_t P = 0; P < PCACHE_MAX_PROBE && P < NumSlots; P++) {
+		Slot& S = Slots[(Key.Lo + P) % NumSlots];
+		uint32_t State = __atomic_load_n(&S.State, __ATOMIC_ACQUIRE);
+		if (State == SS_Empty) {
+			return false;
+		} else if (State == SS_Ready && S.KeyHi == Key.Hi && S.KeyLo == Key.Lo) {
+			Result = (SMTSolver::SMTResultType) __atomic_load_n(&S.Result, __ATOMIC_RELAXED);
+			SolveTimeUs = __atomic_load_n(&S.SolveTimeUs, __ATOMIC_RELAXED);
+			return true;
+		}
+		// a slot being written by others is skipped
+	}
+	return false;
+}
+
+void SMTPersistentCache::insert(const SMTFingerprint& Key, SMTSolver::SMTResultType Result, uint64_t SolveTimeUs) {
+	if (Result != SMTSolver::SMTRT_Sat && Result != SMTSolver::SMTRT_Unsat && Result != SMTSolver::SMTRT_Unknown) {
+		return;
+	}
+
+	uint64_t NumSlots = Head->NumSlots;
+	for (uint64_t P = 0; P < PCACHE_MAX_PROBE && P < NumSlots; P++) {
+		Slot& S = Slots[(Key.Lo + P) % NumSlots];
+		uint32_t State = __atomic_load_n(&S.State, __ATOMIC_ACQUIRE);
+		if (State == SS_Empty) {
+			if (!__atomic_compare_exchange_n(&S.State, &State, (uint32_t) SS_Writing, false,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				// claimed by another process in the meanwhile, which
+				// may have recorded the same query
+				if (State == SS_Ready && S.KeyHi == Key.Hi && S.KeyLo == Key.Lo) {
+					return;
+				}
+				continue;
+			}
+			S.KeyHi = Key.Hi;
+			S.KeyLo = Key.Lo;
+			S.Result = Result;
+			S.SolveTimeUs = SolveTimeUs;
+			__atomic_store_n(&S.State, (uint32_t) SS_Ready, __ATOMIC_RELEASE);
+			__atomic_fetch_add(&Head->NumEntries, 1, __ATOMIC_RELAXED);
+			return;
+		} else if (State == SS_Ready && S.KeyHi == Key.Hi && S.KeyLo == Key.Lo) {
+			if (Result != SMTSolver::SMTRT_Unknown
+					&& __atomic_load_n(&S.Result, __ATOMIC_RELAXED) == SMTSolver::SMTRT_Unknown) {
+				__atomic_store_n(&S.SolveTimeUs, SolveTimeUs, __ATOMIC_RELAXED);
+				__atomic_store_n(&S.Result, (uint32_t) Result, __ATOMIC_RELAXED);
+			}
+			return;
+		}
+	}
+}
@@ -0,0 +1,208 @@
+/**
+ * A multi-threaded portfolio of z3 tactics.
+ */
+
+#include <llvm/Support/CommandLine.h>
+
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include "SMT/SMTPortfolio.h"
+
+static llvm::cl::list<std::string> PortfolioSpecs("solver-portfolio", llvm::cl::CommaSeparated,
+        llvm::cl::desc("Solve each query with these z3 tactics (optionally with \"@<random seed>\") in parallel, "
+                "e.g. smt,qfbv,smt@7, and take the first answer"));
+
+SMTPortfolio* SMTPortfolio::get() {
+	static SMTPortfolio* Portfolio = PortfolioSpecs.empty() ? nullptr
+			: new SMTPortfolio(std::vector<std::string>(PortfolioSpecs.begin(), PortfolioSpecs.end()));
+	return Portfolio;
+}
+
+SMTPortfolio::SMTPortfolio(const std::vector<std::string>& Specs) {
+	for (auto& Spec : Specs) {
+		Member M;
+		size_t At = Spec.find('@');
+		M.Tactic = Spec.substr(0, At);
+		if (At != std::string::npos) {
+			M.Seed = (unsigned) std::stoul(Spec.substr(At + 1));
+		}
+		Members.push_back(M);
+
+		MemberStatistics S;
+		S.Name = Spec;
+		Stats.push_back(S);
+	}
+}
+
+std::unique_ptr<SMTPortfolio::Lane> SMTPortfolio::acquireLane() {
+	{
+		std::lock_guard<std::mutex> L(PortfolioLock);
+		if (!FreeLanes.empty()) {
+			std::unique_ptr<Lane> Ret = std::move(FreeLanes.back());
+			FreeLanes.pop_back();
+			return Ret;
+		}
+	}
+
+	std::unique_ptr<Lane> Ret(new Lane());
+	for (size_t I = 0; I < Members.size(); I++) {
+		Ret->Contexts.emplace_back(new z3::context());
+	}
+	return Ret;
+}
+
+void SMTPortfolio::releaseLane(std::unique_ptr<Lane> L) {
+	std::lock_guard<std::mutex> G(PortfolioLock);
+	FreeLanes.push_back(std::move(L));
+}
+
+z3::check_result SMTPortfolio::check(const z3::expr_vector& Assertions, unsigned TimeoutMs,
+		std::shared_ptr<z3::model>& Model) {
+	auto Start = std::chrono::steady_clock::now();
+	size_t NumMembers = Members.size();
+	std::unique_ptr<Lane> L = acquireLane();
+
+	// Translate on the calling thread, because the context of
+	// the assertions must not be accessed concurrently.
+	std::vector<z3::expr_vector> Inputs;
+	for (size_t I = 0; I < NumMembers; I++) {
+		z3::context& C = *L->Contexts[I];
+		Inputs.push_back(z3::expr_vector(C, Z3_ast_vector_translate(Assertions.ctx(), Assertions, C)));
+	}
+
+	Race R;
+	R.Origin = Assertions.ctx();
+	{
+		std::lock_guard<std::mutex> G(PortfolioLock);
+		Races.push_back(&R);
+	}
+
+	std::vector<bool> Finished(NumMembers, false);
+	std::vector<z3::check_result> Results(NumMembers, z3::check_result::unknown);
+	std::vector<std::shared_ptr<z3::model>> Models(NumMembers);
+
+	std::vector<std::thread> Threads;
+	for (size_t I = 0; I < NumMembers; I++) {
+		Threads.emplace_back([&, I]() {
+			z3::context& C = *L->Contexts[I];
+			z3::check_result Result = z3::check_result::unknown;
+			try {
+				z3::solver S = Members[I].Tactic == "default" ? z3::solver(C)
+						: z3::tactic(C, Members[I].Tactic.c_str()).mk_solver();
+				z3::params Z3Params(C);
+				if (TimeoutMs > 0) {
+					Z3Params.set("timeout", TimeoutMs);
+				}
+				if (Members[I].Seed) {
+					Z3Params.set("random_seed", Members[I].Seed);
+				}
+				S.set(Z3Params);
+				for (unsigned J = 0, E = Inputs[I].size(); J < E; J++) {
+					S.add(Inputs[I][J]);
+				}
+
+				bool Lost;
+				{
+					std::lock_guard<std::mutex> G(R.RaceLock);
+					Lost = R.Winner != -1 || R.Interrupted;
+				}
+				if (!Lost) {
+					Result = S.check();
+					if (Result == z3::check_result::sat) {
+						Models[I] = std::make_shared<z3::model>(S.get_model());
+					}
+				}
+			} catch (z3::exception &Ex) {
+				// e.g. an unknown tactic, or interrupted
+				Result = z3::check_result::unknown;
+			}
+
+			std::lock_guard<std::mutex> G(R.RaceLock);
+			Results[I] = Result;
+			Finished[I] = true;
+			R.NumFinished++;
+			if (Result != z3::check_result::unknown && R.Winner == -1 && !R.Interrupted) {
+				R.Winner = (int) I;
+			}
+			R.RaceCond.notify_all();
+		});
+	}
+
+	{
+		std::unique_lock<std::mutex> G(R.RaceLock);
+		R.RaceCond.wait(G, [&]() { return R.Winner != -1 || R.Interrupted || R.NumFinished == NumMembers; });
+
+		// Stop the losers. An interruption arriving before a thread starts
+		// solving may be missed, so interrupt until it finishes.
+		for (size_t I = 0; I < NumMembers; I++) {
+			while (!Finished[I]) {
+				Z3_interrupt(*L->Contexts[I]);
+				R.RaceCond.wait_for(G, std::chrono::milliseconds(5));
+			}
+		}
+	}
+	for (auto& T : Threads) {
+		T.join();
+	}
+	{
+		std::lock_guard<std::mutex> G(PortfolioLock);
+		Races.erase(std::find(Races.begin(), Races.end(), &R));
+	}
+	int Winner = R.Winner;
+
+	auto Time = std::chrono::steady_clock::now() - Start;
+	z3::check_result Ret = z3::check_result::unknown;
+	if (Winner != -1) {
+		Ret = Results[Winner];
+		if (Ret == z3::check_result::sat) {
+			z3::context& C = *L->Contexts[Winner];
+			Model = std::make_shared<z3::model>(Assertions.ctx(),
+					Z3_model_translate(C, *Models[Winner], Assertions.ctx()));
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> G(PortfolioLock);
+		for (size_t I = 0; I < NumMembers; I++) {
+			Stats[I].Runs++;
+		}
+		if (Winner != -1) {
+			Stats[Winner].Wins++;
+			Stats[Winner].WinTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(Time).count();
+		}
+	}
+
+	// The exprs and models must die before their contexts are reused.
+	Models.clear();
+	Inputs.clear();
+	releaseLane(std::move(L));
+	return Ret;
+}
+
+void SMTPortfolio::interrupt(Z3_context Origin) {
+	std::lock_guard<std::mutex> G(PortfolioLock);
+	for (Race* R : Races) {
+		if (R->Origin == Origin) {
+			std::lock_guard<std::mutex> RG(R->RaceLock);
+			R->Interrupted = true;
+			R->RaceCond.notify_all();
+		}
+	}
+}
+
+std::vector<SMTPortfolio::MemberStatistics> SMTPortfolio::getStatistics() {
+	std::lock_guard<std::mutex> G(PortfolioLock);
+	return Stats;
+}
+
+void SMTPortfolio::printStatistics(llvm::raw_ostream& O) {
+	for (auto& S : getStatistics()) {
+		O << S.Name << ": " << S.Wins << "/" << S.Runs << " wins";
+		if (S.Wins) {
+			O << ", " << (S.WinTimeUs / S.Wins) << "us per win";
+		}
+		O << "\n";
+	}
+}
@@ -0,0 +1,97 @@
+/**
+ * Query result cache shared by the solvers of one SMTFactory.
+ */
+
+#include <algorithm>
+#include <cassert>
+
+#include "SMT/SMTQueryCache.h"
+
+size_t SMTQueryCache::KeyHash::operator()(const KeyTy& Key) const {
+	// FNV-1a over the (sorted) ids
+	uint64_t Hash = 14695981039346656037ULL;
+	for (unsigned Id : Key) {
+		Hash ^= Id;
+		Hash *= 1099511628211ULL;
+	}
+	return (size_t) Hash;
+}
+
+SMTQueryCache::SMTQueryCache(size_t Cap) : Capacity(Cap) {
+}
+
+SMTQueryCache::KeyTy SMTQueryCache::makeKey(const z3::expr_vector& Assertions) {
+	KeyTy Key;
+	Key.reserve(Assertions.size());
+	for (unsigned I = 0, E = Assertions.size(); I < E; I++) {
+		z3::expr A = Assertions[I];
+		if (A.is_true()) {
+			continue;
+		}
+		Key.push_back(Z3_get_ast_id(A.ctx(), A));
+	}
+	std::sort(Key.begin(), Key.end());
+	Key.erase(std::unique(Key.begin(), Key.end()), Key.end());
+	return Key;
+}
+
+void SMTQueryCache::setCapacity(size_t Cap) {
+	Capacity = Cap;
+	while (Entries.size() > Capacity) {
+		evict();
+	}
+}
+
+bool SMTQueryCache::lookup(const z3::expr_vector& Assertions, SMTSolver::SMTResultType& Result) {
+	if (!enabled()) {
+		return false;
+	}
+
+	auto It = Index.find(makeKey(Assertions));
+	if (It == Index.end()) {
+		Stats.Misses++;
+		return false;
+	}
+
+	// move to the front of the LRU list
+	Entries.splice(Entries.begin(), Entries, It->second);
+	Result = It->second->Result;
+	Stats.Hits++;
+	return true;
+}
+
+void SMTQueryCache::insert(const z3::expr_vector& Assertions, SMTSolver::SMTResultType Result) {
+	if (!enabled()) {
+		return;
+	}
+	if (Result != SMTSolver::SMTRT_Sat && Result != SMTSolver::SMTRT_Unsat) {
+		return;
+	}
+
+	auto Ins = Index.insert(std::make_pair(makeKey(Assertions), Entries.end()));
+	if (!Ins.second) {
+		// solved by another solver of the factory in the meanwhile
+		Entries.splice(Entries.begin(), Entries, Ins.first->second);
+		Ins.first->second->Result = Result;
+		return;
+	}
+
+	Entries.push_front(Entry { &Ins.first->first, Assertions, Result });
+	Ins.first->second = Entries.begin();
+
+	while (Entries.size() > Capacity) {
+		evict();
+	}
+}
+
+void SMTQueryCache::evict() {
+	assert(!Entries.empty());
+	Index.erase(*Entries.back().Key);
+	Entries.pop_back();
+	Stats.Evictions++;
+}
+
+void SMTQueryCache::clear() {
+	Index.clear();
+	Entries.clear();
+}
@@ -9,8 +9,22 @@
 #include "SMT/SMTFactory.h"
 #include "SMT/SMTExpr.h"
 #include "SMT/SMTModel.h"
+#include "SMT/SMTQueryCache.h"
+#include "SMT/SMTPersistentCache.h"
+#include "SMT/SMTUnsatCoreCache.h"
+#include "SMT/SMTModelPool.h"
+#include "SMT/SMTPortfolio.h"
+#include "SMT/SMTCheckFuture.h"
+#include "SMT/SMTTelemetry.h"
+#include "SMT/SMTDumpWriter.h"
+#include "SMT/SMTVarEliminator.h"
+#include "SMT/SMTFragment.h"
+#include "SMT/SMTDilligSimplifier.h"
 
 #include "SMT/SMTLIBSolver.h"
+#include "SMT/SMTLIBSolverPool.h"
+#include "SMT/SMTLIBPortfolio.h"
+#include "SMT/SMTLIBWriter.h"
 #include "SMT/SMTConfigure.h"
 // #include "SMT/PushPopUtil.h"
 
@@ -22,7 +36,10 @@
 #include <fstream>
 #include <vector>
 #include <chrono>
+#include <algorithm>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #define DEBUG_TYPE "solver"
 
@@ -31,9 +48,6 @@ using namespace llvm;
 static llvm::cl::opt<std::string> UsingSimplify("solver-simplify", llvm::cl::init(""),
         llvm::cl::desc("Using online simplification technique. Candidates are local and dillig."));
 
-static llvm::cl::opt<std::string> DumpingConstraintsDst("dump-cnts-dst", llvm::cl::init(""),
-        llvm::cl::desc("If solving time is larger than the time that -dump-cnts-timeout, the constraints will be output the destination."));
-
 static llvm::cl::opt<int> DumpingConstraintsTimeout("dump-cnts-timeout",
         llvm::cl::desc("If solving time is too large (ms), the constraints will be output to the destination that -dump-cnts-dst set."));
 
@@ -45,6 +59,24 @@ static llvm::cl::opt<int> EnableSMTD("solver-enable-smtd", llvm::cl::init(0), ll
 static llvm::cl::opt<bool> EnableSMTDIncremental("solver-enable-smtd-incremental", llvm::cl::init(false),
         llvm::cl::desc("Using incremental when smtd is enabled"));
 
+static llvm::cl::opt<bool> EnableIndependenceSlicing("solver-independence-slicing", llvm::cl::init(false),
+        llvm::cl::desc("Solve the components of a query that do not share variables separately, and cache their results "
+                "(not with -solver-simplify or incremental SMTLIB solvers)"));
+
+static llvm::cl::opt<bool> EnableLazyAdd("solver-lazy-add", llvm::cl::init(false),
+        llvm::cl::desc("Buffer the added constraints until the next check/push, dropping duplicates and "
+                "detecting the clashes of a literal and its negation"));
+
+static llvm::cl::opt<bool> EnableVarElimination("solver-eliminate-vars", llvm::cl::init(false),
+        llvm::cl::desc("Eliminate the variables defined by top-level equalities (e.g. x == a + b) "
+                "before the query is sent to the backend"));
+
+static llvm::cl::opt<bool> RouteByLogic("solver-route-by-logic", llvm::cl::init(false),
+        llvm::cl::desc("Solve the queries of nonlinear arithmetic (QF_NIA and QF_NRA) natively by a fresh z3 "
+                "solver of their logic, which uses nlsat, instead of the incremental solver. The other fragments "
+                "(e.g. pure Boolean, QF_BV, QF_ABV and linear arithmetic) are not routed, since the incremental "
+                "solver is faster on them."));
+
 static llvm::cl::opt<bool> EnableLocalSimplify("enable-local-simplify", llvm::cl::init(true),
                                                llvm::cl::desc("Enable local simplifications while adding a vector of constraints"));
 
@@ -60,9 +92,315 @@ std::string join(const T& v) {
     return s.str();
 }
 
+/// The logic declared to an SMTLIB solver for the fragment \p F
+static std::string declaredLogic(const SMTFragment& F) {
+    if (SMTConfig::SMTLIBLogic != "auto") {
+        return SMTConfig::SMTLIBLogic;
+    }
+    // ALL is rejected by some solvers (e.g. boolector)
+    std::string Logic = F.getLogic();
+    return Logic == "ALL" ? SMTConfig::SMTLIBFallbackLogic : Logic;
+}
+
 // only for debugging (single-thread)
 bool SMTSolvingTimeOut = false;
 
+/// The ids of the uninterpreted symbols (constants and functions) in
+/// \p E, which connect the assertions sharing them in checkSliced().
+static void collectSymbols(z3::context& Ctx, Z3_ast E, std::vector<unsigned>& Symbols) {
+    std::unordered_set<unsigned> Visited;
+    std::vector<Z3_ast> Worklist(1, E);
+    while (!Worklist.empty()) {
+        Z3_ast Node = Worklist.back();
+        Worklist.pop_back();
+        if (!Visited.insert(Z3_get_ast_id(Ctx, Node)).second) {
+            continue;
+        }
+        if (Z3_get_ast_kind(Ctx, Node) == Z3_QUANTIFIER_AST) {
+            Worklist.push_back(Z3_get_quantifier_body(Ctx, Node));
+        } else if (Z3_get_ast_kind(Ctx, Node) == Z3_APP_AST) {
+            Z3_app App = Z3_to_app(Ctx, Node);
+            Z3_func_decl Decl = Z3_get_app_decl(Ctx, App);
+            if (Z3_get_decl_kind(Ctx, Decl) == Z3_OP_UNINTERPRETED) {
+                Symbols.push_back(Z3_get_func_decl_id(Ctx, Decl));
+            }
+            for (unsigned I = 0, N = Z3_get_app_num_args(Ctx, App); I < N; I++) {
+                Worklist.push_back(Z3_get_app_arg(Ctx, App, I));
+            }
+        }
+    }
+}
+
+/// Copy the interpretations of \p From into \p Into, which interprets
+/// different symbols, except those of the constants in \p Skipped (by
+/// their AST ids).
+static void mergeModel(z3::model& Into, const z3::model& From, const std::unordered_set<unsigned>* Skipped = nullptr) {
+    for (unsigned I = 0, N = From.num_consts(); I < N; I++) {
+        z3::func_decl Decl = From.get_const_decl(I);
+        if (Skipped && Skipped->count(Z3_get_ast_id(From.ctx(), Decl()))) {
+            continue;
+        }
+        z3::expr Value = From.get_const_interp(Decl);
+        Into.add_const_interp(Decl, Value);
+    }
+    for (unsigned I = 0, N = From.num_funcs(); I < N; I++) {
+        z3::func_decl Decl = From.get_func_decl(I);
+        z3::func_interp Interp = From.get_func_interp(Decl);
+        z3::expr Else = Interp.else_value();
+        z3::func_interp Copy = Into.add_func_interp(Decl, Else);
+        for (unsigned J = 0, M = Interp.num_entries(); J < M; J++) {
+            z3::func_entry Entry = Interp.entry(J);
+            z3::expr_vector Args(From.ctx());
+            for (unsigned K = 0, A = Entry.num_args(); K < A; K++) {
+                Args.push_back(Entry.arg(K));
+            }
+            z3::expr Value = Entry.value();
+            Copy.add_entry(Args, Value);
+        }
+    }
+}
+
+struct SMTSolver::TrailNode {
+    /// mutable, so that the destructor can unlink it
+    mutable std::shared_ptr<const TrailNode> Parent;
+
+    /// a push marker, or an assertion
+    bool IsPush;
+    z3::expr Expr;
+
+    TrailNode(std::shared_ptr<const TrailNode> P, bool Push, z3::expr E) :
+            Parent(std::move(P)), IsPush(Push), Expr(E) {
+    }
+
+    ~TrailNode() {
+        // Release the ancestors iteratively. Otherwise destroying
+        // a long trail recursively may overflow the stack.
+        std::shared_ptr<const TrailNode> P = std::move(Parent);
+        while (P && P.use_count() == 1) {
+            std::shared_ptr<const TrailNode> Next = std::move(P->Parent);
+            P = std::move(Next);
+        }
+    }
+};
+
+struct SMTSolver::AddBuffer {
+    /// The assertions of the open scopes, flushed or not, without
+    /// duplicates, and the size of Asserted when each scope is pushed.
+    std::vector<z3::expr> Asserted;
+    std::vector<size_t> Scopes;
+
+    /// AST ids of Asserted
+    std::unordered_set<unsigned> AssertedIds;
+
+    /// AST ids of y for each "not y" in Asserted
+    std::unordered_set<unsigned> NegatedIds;
+
+    /// The assertions not yet added to the z3 solver. They are all
+    /// in the innermost scope, since push() flushes the buffer.
+    std::vector<z3::expr> Pending;
+
+    /// If a literal and its negation (or false) are asserted, and
+    /// the number of scopes when the clash is found.
+    bool Conflict = false;
+    size_t ConflictDepth = 0;
+
+    /// Returns false if \p E is already asserted.
+    bool record(const z3::expr& E) {
+        unsigned Id = Z3_get_ast_id(E.ctx(), E);
+        if (!AssertedIds.insert(Id).second) {
+            return false;
+        }
+        Asserted.push_back(E);
+
+        bool Clash = E.is_false();
+        if (E.is_app() && E.decl().decl_kind() == Z3_OP_NOT) {
+            unsigned NegatedId = Z3_get_ast_id(E.ctx(), E.arg(0));
+            NegatedIds.insert(NegatedId);
+            Clash = Clash || AssertedIds.count(NegatedId);
+        } else {
+            Clash = Clash || NegatedIds.count(Id);
+        }
+        if (Clash && !Conflict) {
+            Conflict = true;
+            ConflictDepth = Scopes.size();
+        }
+        return true;
+    }
+
+    void push() {
+        Scopes.push_back(Asserted.size());
+    }
+
+    void pop(unsigned N) {
+        assert(N <= Scopes.size());
+        size_t Start = Scopes[Scopes.size() - N];
+        Scopes.resize(Scopes.size() - N);
+        for (size_t I = Start; I < Asserted.size(); I++) {
+            z3::expr& E = Asserted[I];
+            AssertedIds.erase(Z3_get_ast_id(E.ctx(), E));
+            if (E.is_app() && E.decl().decl_kind() == Z3_OP_NOT) {
+                NegatedIds.erase(Z3_get_ast_id(E.ctx(), E.arg(0)));
+            }
+        }
+        Asserted.erase(Asserted.begin() + Start, Asserted.end());
+        Pending.clear();
+        if (Conflict && Scopes.size() < ConflictDepth) {
+            Conflict = false;
+        }
+    }
+
+    void reset() {
+        Asserted.clear();
+        Scopes.clear();
+        AssertedIds.clear();
+        NegatedIds.clear();
+        Pending.clear();
+        Conflict = false;
+    }
+};
+
+struct SMTSolver::SMTLIBMirror {
+    /// The assertions of the open scopes. The ones not yet sent to
+    /// the external solver are returned by Added.getCacheVector(false).
+    PushPopVec<z3::expr> Added;
+
+    /// It writes to the external solver, and knows the symbols and
+    /// shared subterms defined there, which are popped with their scopes.
+    SMTLIBWriter Writer;
+
+    /// The generation of the external solver process holding the
+    /// assertions sent so far. See SmtlibSmtSolver::getGeneration().
+    unsigned Generation = 0;
+
+    /// The logic declared to the external solver ("" if none yet), and
+    /// the fragment it is declared for, which only grows until reset().
+    std::string Logic;
+    SMTFragment Declared;
+
+    explicit SMTLIBMirror(SmtlibSmtSolver* Solver) : Writer([Solver](const char* Data, size_t Size) {
+        Solver->writeData(Data, Size);
+    }) {
+    }
+
+    /// Send the declarations of the new symbols in the unsent
+    /// assertions, and the assertions.
+    void sendDelta() {
+        auto Delta = Added.getCacheVector(false);
+        Writer.addAll(Delta.first, Delta.second);
+        Writer.flush();
+    }
+
+    /// Send all scopes and assertions to \p Solver, a restarted process.
+    void resend(SmtlibSmtSolver& Solver) {
+        Writer.reset();
+
+        const std::vector<z3::expr>& All = Added.getCacheVector();
+        const std::vector<size_t>& Scopes = Added.getCacheStack();
+        size_t Begin = 0;
+        for (size_t Level = 0; Level <= Scopes.size(); Level++) {
+            size_t End = Level < Scopes.size() ? Scopes[Level] : All.size();
+            Writer.addAll(All.begin() + Begin, All.begin() + End);
+            Writer.flush();
+            if (Level < Scopes.size()) {
+                Solver.push(1);
+                Writer.push();
+            }
+            Begin = End;
+        }
+        // all of them are sent
+        Added.getCacheVector(false);
+    }
+
+    void push() {
+        Added.push();
+        Writer.push();
+    }
+
+    void pop(unsigned N) {
+        Added.pop(N);
+        Writer.pop(N);
+    }
+
+    void reset() {
+        Added.reset();
+        Writer.reset();
+        Logic.clear();
+        Declared = SMTFragment();
+    }
+};
+
+struct SMTSolver::ForkState {
+    /// The last assertion or push marker; nodes are shared by forks.
+    std::shared_ptr<const TrailNode> Head;
+
+    /// If the z3 solver holds the assertions of the trail.
+    bool Materialized = true;
+
+    /// The tactic of the z3 solver ("" for the default solver),
+    /// used by fork() to create a solver of the same kind.
+    std::string Tactic;
+};
+
+struct SMTSolver::SimplifyState {
+    /// It mirrors the scopes of the solver, and holds the
+    /// simplified forms of the assertions of the solver.
+    z3::solver Solver4Sim;
+
+    /// The assertions added to the solver. The ones added since the last
+    /// check are obtained by getCacheVector(false).
+    PushPopVec<z3::expr> Added;
+
+    /// AST id of an assertion -> <assertion, simplified form>.
+    /// The assertion is kept alive, so that its id is not reused.
+    std::unordered_map<unsigned, std::pair<z3::expr, z3::expr>> Memo;
+
+    explicit SimplifyState(z3::context& Ctx) : Solver4Sim(Ctx) {
+    }
+};
+
+static const size_t SimplifyMemoSize = 1 << 16;
+
+struct SMTSolver::AssumptionState {
+    struct Indicator {
+        /// kept alive, so that its AST id is not reused
+        z3::expr Assumption;
+        z3::expr Literal;
+        /// the scope level where "Literal => Assumption" is asserted
+        unsigned Level;
+    };
+
+    /// AST id of an assumption -> its indicator
+    std::unordered_map<unsigned, Indicator> Indicators;
+
+    /// <literal, assumption> in the unsat core of the last checkAssuming()
+    std::vector<std::pair<z3::expr, z3::expr>> Core;
+
+    bool CoreMinimized = false;
+
+    /// AST ids of the indicator literals
+    std::unordered_set<unsigned> literalIds() const {
+        std::unordered_set<unsigned> Ret;
+        for (auto& It : Indicators) {
+            const z3::expr& Literal = It.second.Literal;
+            Ret.insert(Z3_get_ast_id(Literal.ctx(), Literal));
+        }
+        return Ret;
+    }
+
+    /// Drop the indicators whose guards have been popped.
+    void popTo(unsigned Level) {
+        for (auto It = Indicators.begin(); It != Indicators.end();) {
+            if (It->second.Level > Level) {
+                It = Indicators.erase(It);
+            } else {
+                ++It;
+            }
+        }
+        Core.clear();
+        CoreMinimized = false;
+    }
+};
+
 SMTSolver::SMTSolver(SMTFactory* F, z3::solver& Z3Solver) : SMTObject(F),
         Solver(Z3Solver) {
 
@@ -73,6 +411,25 @@ SMTSolver::SMTSolver(SMTFactory* F, z3::solver& Z3Solver) : SMTObject(F),
         Z3Solver.set(Z3Params);
     }
 
+    Assumptions = std::make_shared<AssumptionState>();
+    Fork = std::make_shared<ForkState>();
+    Fragments = std::make_shared<SMTFragmentClassifier>();
+    if (EnableLazyAdd.getValue()) {
+        Buffer = std::make_shared<AddBuffer>();
+    }
+    if (EnableVarElimination.getValue()) {
+        Elimination = std::make_shared<SMTVarEliminator>(Z3Solver.ctx());
+    }
+
+    if (UsingSimplify.getNumOccurrences()) {
+        Simplification = std::make_shared<SimplifyState>(Z3Solver.ctx());
+        if (SolverTimeOut.getValue() > 0) {
+            z3::params Z3Params(Z3Solver.ctx());
+            Z3Params.set("timeout", (unsigned) SolverTimeOut.getValue());
+            Simplification->Solver4Sim.set(Z3Params);
+        }
+    }
+
     if (EnableSMTD.getNumOccurrences()) {
         Channels = std::make_shared<SMTDMessageQueues>();
 
@@ -123,17 +480,22 @@ SMTSolver::SMTSolver(SMTFactory* F, z3::solver& Z3Solver) : SMTObject(F),
         if (SmtlibSolver == NULL) {
             std::cout << "Creating SMTLIB solver failure!!!\n";
         }
-        // SmtlibSolver->setLogic("QF_BV");
+        // the logic is declared by flushToSMTLIB()
+        Mirror = std::make_shared<SMTLIBMirror>(SmtlibSolver);
     }
 }
 
 SMTSolver::SMTSolver(const SMTSolver& Solver) : SMTObject(Solver),
-        Solver(Solver.Solver), Channels(Solver.Channels) {
+        Solver(Solver.Solver), ModelPending(Solver.ModelPending), CoreRecorded(Solver.CoreRecorded), WitnessModel(Solver.WitnessModel),
+        UnmodeledAssertions(Solver.UnmodeledAssertions), LastBackend(Solver.LastBackend), ReasonUnknown(Solver.ReasonUnknown), Z3Statistics(Solver.Z3Statistics),
+        Simplification(Solver.Simplification),
+        Assumptions(Solver.Assumptions), Fork(Solver.Fork), Buffer(Solver.Buffer),
+        Elimination(Solver.Elimination), Fragments(Solver.Fragments), Mirror(Solver.Mirror),
+        Channels(Solver.Channels) {
 
     if (SMTConfig::UseIncrementalSMTLIBSolver) {
-        SmtlibSolver = Solver.SmtlibSolver; // TODO: is this correct? 
-        //SmtlibSolver = createSMTLIBSolver();
-        //AssertionsCache = Solver.AssertionsCache; // correct?     
+        // the copies share the external solver like the z3 solver
+        SmtlibSolver = Solver.SmtlibSolver;
     }
 }
 
@@ -141,13 +503,25 @@ SMTSolver& SMTSolver::operator=(const SMTSolver& Solver) {
     SMTObject::operator =(Solver);
     if (this != &Solver) {
         this->Solver = Solver.Solver;
+        this->ModelPending = Solver.ModelPending;
+        this->CoreRecorded = Solver.CoreRecorded;
+        this->WitnessModel = Solver.WitnessModel;
+        this->UnmodeledAssertions = Solver.UnmodeledAssertions;
+        this->LastBackend = Solver.LastBackend;
+        this->ReasonUnknown = Solver.ReasonUnknown;
+        this->Z3Statistics = Solver.Z3Statistics;
+        this->Simplification = Solver.Simplification;
+        this->Assumptions = Solver.Assumptions;
+        this->Fork = Solver.Fork;
+        this->Buffer = Solver.Buffer;
+        this->Elimination = Solver.Elimination;
+        this->Fragments = Solver.Fragments;
+        this->Mirror = Solver.Mirror;
         this->Channels = Solver.Channels;
     }
 
     if (SMTConfig::UseIncrementalSMTLIBSolver) {
-        SmtlibSolver = Solver.SmtlibSolver; // TODO: is this correct?
-        //SmtlibSolver = createSMTLIBSolver(); 
-        //AssertionsCache = Solver.AssertionsCache; // correct?     
+        SmtlibSolver = Solver.SmtlibSolver;
     }
 
     return *this;
@@ -185,15 +559,444 @@ void SMTSolver::reconnect() {
 }
 
 SMTSolver::SMTResultType SMTSolver::check() {
+    materialize();
+
+    if (!SMTTelemetry::enabled()) {
+        return checkWithCaches();
+    }
+
+    SMTStopwatch Watch;
+    SMTResultType Result = checkWithCaches();
+
+    SMTTelemetry::QueryRecord Record;
+    Record.WallTimeUs = Watch.getWallTimeUs();
+    Record.CPUTimeUs = Watch.getThreadCPUTimeUs();
+    Record.Tag = getSMTFactory().getTelemetryTag();
+    Record.Backend = LastBackend;
+    Record.Result = Result;
+    try {
+        z3::expr_vector Assertions = queryAssertions();
+        Record.NumAssertions = Assertions.size();
+        Record.DagSize = SMTTelemetry::dagSize(Assertions);
+        Record.Z3Statistics = Z3Statistics;
+    } catch (z3::exception &Ex) {
+        std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+    }
+    getSMTFactory().getTelemetry().record(std::move(Record));
+    return Result;
+}
+
+SMTSolver::SMTResultType SMTSolver::checkWithCaches() {
+    // The caches of the factory are not locked, so two threads must not
+    // check at once, i.e. without holding the FactoryLock.
+    struct CacheUse {
+        std::atomic<bool>& InUse;
+        explicit CacheUse(std::atomic<bool>& Flag) : InUse(Flag) {
+            bool Concurrent = InUse.exchange(true);
+            assert(!Concurrent && "The solvers of a factory are checked concurrently without its FactoryLock!");
+            (void) Concurrent;
+        }
+        ~CacheUse() {
+            InUse = false;
+        }
+    } Use(getSMTFactory().CachesInUse);
+
+    ModelPending = false;
+    CoreRecorded = false;
+    WitnessModel.reset();
+    UnmodeledAssertions.reset();
+    ReasonUnknown.clear();
+    Z3Statistics.clear();
+
+    if (Buffer && Buffer->Conflict) {
+        DEBUG(std::cerr << "Trivial conflict in the added constraints\n");
+        LastBackend = "trivial-conflict";
+        return SMTRT_Unsat;
+    }
+
+    SMTQueryCache& QueryCache = getSMTFactory().getQueryCache();
+    SMTUnsatCoreCache& UnsatCoreCache = getSMTFactory().getUnsatCoreCache();
+    SMTModelPool& ModelPool = getSMTFactory().getModelPool();
+    SMTPersistentCache* PersistentCache = SMTPersistentCache::get();
+    if (!QueryCache.enabled() && !UnsatCoreCache.enabled() && !ModelPool.enabled() && !PersistentCache
+            && !EnableIndependenceSlicing.getValue()) {
+        return checkBackend();
+    }
+
+    z3::expr_vector Assertions = queryAssertions();
+    SMTResultType Result;
+    if (QueryCache.lookup(Assertions, Result)) {
+        DEBUG(std::cerr << "Query cache hit: " << Result << "\n");
+        LastBackend = "query-cache";
+        ModelPending = Result == SMTRT_Sat;
+        return Result;
+    }
+
+    if (UnsatCoreCache.containsCoreOf(Assertions)) {
+        DEBUG(std::cerr << "Unsat core cache hit\n");
+        LastBackend = "unsat-core-cache";
+        QueryCache.insert(Assertions, SMTRT_Unsat);
+        return SMTRT_Unsat;
+    }
+
+    WitnessModel = ModelPool.findModelOf(Assertions);
+    if (WitnessModel) {
+        DEBUG(std::cerr << "Model reused\n");
+        LastBackend = "model-pool";
+        QueryCache.insert(Assertions, SMTRT_Sat);
+        return SMTRT_Sat;
+    }
+
+    SMTFingerprint Fingerprint;
+    if (PersistentCache) {
+        Fingerprint = SMTFingerprint::of(Assertions);
+        uint64_t SolveTimeUs;
+        // An unknown result is reused only if it is a timeout under
+        // a budget not smaller than the current one.
+        if (PersistentCache->lookup(Fingerprint, Result, SolveTimeUs) && (Result != SMTRT_Unknown
+                || (SolverTimeOut.getValue() > 0 && SolveTimeUs >= (uint64_t) SolverTimeOut.getValue() * 1000))) {
+            DEBUG(std::cerr << "Persistent cache hit: " << Result << "\n");
+            LastBackend = "persistent-cache";
+            QueryCache.insert(Assertions, Result);
+            ModelPending = Result == SMTRT_Sat;
+            return Result;
+        }
+    }
+
+    auto Start = std::chrono::steady_clock::now();
+    Result = EnableIndependenceSlicing.getValue() ? checkSliced(Assertions) : checkBackend();
+    QueryCache.insert(Assertions, Result);
+    if (Result == SMTRT_Unsat && UnsatCoreCache.enabled()) {
+        if (!CoreRecorded) {
+            recordUnsatCore(Assertions);
+        }
+    } else if (Result == SMTRT_Sat && ModelPool.enabled() && WitnessModel) {
+        if (!UnmodeledAssertions) {
+            ModelPool.insert(*WitnessModel);
+        }
+    } else if (Result == SMTRT_Sat && ModelPool.enabled() && !ModelPending) {
+        try {
+            ModelPool.insert(getZ3Model());
+        } catch (z3::exception &Ex) {
+            std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+        }
+    }
+    if (PersistentCache) {
+        auto SolveTime = std::chrono::steady_clock::now() - Start;
+        PersistentCache->insert(Fingerprint, Result,
+                std::chrono::duration_cast<std::chrono::microseconds>(SolveTime).count());
+    }
+    return Result;
+}
+
+z3::check_result SMTSolver::checkSimplified() {
+    flushToSimplification();
+    return Simplification->Solver4Sim.check();
+}
+
+void SMTSolver::flushToSimplification() {
+    SimplifyState& State = *Simplification;
+    SMTStopwatch Watch;
+
+    // Simplify the assertions added since the last flush only. The older
+    // ones are already in Solver4Sim, at the same scope levels, since
+    // pushNow() flushes the outer scope before pushing.
+    auto Delta = State.Added.getCacheVector(false);
+    // one engine for the delta, so that its assertions share a budget
+    // and a memo of the leaves
+    std::unique_ptr<SMTDilligSimplifier> Dillig;
+    for (auto It = Delta.first; It != Delta.second; ++It) {
+        z3::expr& Assertion = *It;
+        unsigned Id = Z3_get_ast_id(Assertion.ctx(), Assertion);
+
+        auto MemoIt = State.Memo.find(Id);
+        if (MemoIt == State.Memo.end()) {
+            SMTExpr E(&getSMTFactory(), Assertion);
+            z3::expr Simplified = Assertion;
+            if (UsingSimplify.getValue() == "local") {
+                Simplified = E.localSimplify().Expr;
+            } else if (UsingSimplify.getValue() == "dillig") {
+                if (!Dillig) {
+                    Dillig.reset(new SMTDilligSimplifier(Assertion.ctx()));
+                }
+                Simplified = Dillig->simplify(Assertion);
+            }
+
+            if (State.Memo.size() >= SimplifyMemoSize) {
+                State.Memo.clear();
+            }
+            MemoIt = State.Memo.insert(std::make_pair(Id, std::make_pair(Assertion, Simplified))).first;
+        }
+        State.Solver4Sim.add(MemoIt->second.second);
+    }
+
+    DEBUG(std::cerr << "Simplifying Done: (" << Watch.getWallTimeUs() / 1000.0 << ", "
+            << (Delta.second - Delta.first) << " new assertions)\n");
+}
+
+SMTSolver::SMTResultType SMTSolver::checkSliced(const z3::expr_vector& Assertions) {
+    if (Simplification || Mirror) {
+        // they mirror the scopes of Solver, and cannot solve a component
+        return checkBackend();
+    }
+
+    z3::context& Ctx = Solver.ctx();
+    unsigned NumAssertions = Assertions.size();
+
+    // 1. union-find over the assertions, connecting the ones sharing
+    // variables or uninterpreted functions
+    std::vector<unsigned> Parent(NumAssertions);
+    for (unsigned I = 0; I < NumAssertions; I++) {
+        Parent[I] = I;
+    }
+    auto Find = [&Parent](unsigned I) {
+        while (Parent[I] != I) {
+            Parent[I] = Parent[Parent[I]];
+            I = Parent[I];
+        }
+        return I;
+    };
+
+    std::unordered_map<unsigned, unsigned> SymbolOwner;
+    for (unsigned I = 0; I < NumAssertions; I++) {
+        std::vector<unsigned> Symbols;
+        collectSymbols(Ctx, Assertions[I], Symbols);
+        for (unsigned SymbolId : Symbols) {
+            auto It = SymbolOwner.find(SymbolId);
+            if (It == SymbolOwner.end()) {
+                SymbolOwner[SymbolId] = I;
+            } else {
+                Parent[Find(I)] = Find(It->second);
+            }
+        }
+    }
+
+    std::map<unsigned, z3::expr_vector> Components;
+    for (unsigned I = 0; I < NumAssertions; I++) {
+        auto It = Components.find(Find(I));
+        if (It == Components.end()) {
+            It = Components.insert(std::make_pair(Find(I), z3::expr_vector(Ctx))).first;
+        }
+        It->second.push_back(Assertions[I]);
+    }
+
+    if (Components.size() <= 1) {
+        return checkBackend();
+    }
+    DEBUG(std::cerr << "Sliced into " << Components.size() << " components\n");
+
+    // The core of an unsat component is a core of the query, and is
+    // cheaper to extract than that of the query in checkWithCaches().
+    auto RecordCore = [this](const z3::expr_vector& Component) {
+        if (getSMTFactory().getUnsatCoreCache().enabled() && !CoreRecorded) {
+            recordUnsatCore(Component);
+        }
+    };
+
+    // 2. look up the cache first, since one cached unsat component is enough
+    SMTQueryCache& ComponentCache = getSMTFactory().getComponentCache();
+    std::vector<z3::expr_vector*> Unsolved;
+    auto Unmodeled = std::make_shared<z3::expr_vector>(Ctx);
+    for (auto& It : Components) {
+        SMTResultType Result;
+        if (ComponentCache.lookup(It.second, Result)) {
+            if (Result == SMTRT_Unsat) {
+                LastBackend = "sliced";
+                RecordCore(It.second);
+                return SMTRT_Unsat;
+            } else if (Result == SMTRT_Sat) {
+                for (unsigned I = 0, E = It.second.size(); I < E; I++) {
+                    Unmodeled->push_back(It.second[I]);
+                }
+            }
+        } else {
+            Unsolved.push_back(&It.second);
+        }
+    }
+
+    // 3. solve the remaining components by the backend, and merge their models
+    SMTResultType Ret = SMTRT_Sat;
+    z3::model Merged(Ctx);
+    for (z3::expr_vector* Component : Unsolved) {
+        z3::solver ComponentSolver = newZ3Solver();
+        SMTFragmentClassifier Classifier;
+        for (unsigned I = 0, E = Component->size(); I < E; I++) {
+            ComponentSolver.add((*Component)[I]);
+            Classifier.add((*Component)[I]);
+        }
+
+        ModelPending = false;
+        WitnessModel.reset();
+        SMTResultType Result = checkBackend(ComponentSolver, Classifier.current());
+        ComponentCache.insert(*Component, Result);
+        if (Result == SMTRT_Unsat) {
+            WitnessModel.reset();
+            LastBackend = "sliced";
+            RecordCore(*Component);
+            return SMTRT_Unsat;
+        } else if (Result == SMTRT_Unknown) {
+            Ret = SMTRT_Unknown;
+        } else if (WitnessModel) {
+            mergeModel(Merged, *WitnessModel);
+        } else if (!ModelPending) {
+            try {
+                mergeModel(Merged, ComponentSolver.get_model());
+            } catch (z3::exception &Ex) {
+                std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+                ModelPending = true;
+            }
+        }
+        if (Result == SMTRT_Sat && ModelPending) {
+            // e.g. the model is in an SMTLIB solver
+            for (unsigned I = 0, E = Component->size(); I < E; I++) {
+                Unmodeled->push_back((*Component)[I]);
+            }
+        }
+    }
+
+    LastBackend = "sliced";
+    ModelPending = false;
+    WitnessModel.reset();
+    if (Ret == SMTRT_Sat) {
+        WitnessModel = std::make_shared<z3::model>(Merged);
+        if (Unmodeled->size()) {
+            UnmodeledAssertions = Unmodeled;
+        }
+    }
+    return Ret;
+}
+
+void SMTSolver::recordUnsatCore(const z3::expr_vector& Assertions) {
+    // The query is solved again by z3 with tracking literals, since the
+    // backend may not provide cores (e.g. smtd and SMTLIB solvers), and
+    // the solver may not be incremental. The default smt solver is used
+    // for the tracked solve, since the tactic solvers (e.g. qfbv) answer
+    // unsat under assumptions with an empty core.
+    z3::context& Ctx = Solver.ctx();
+    try {
+        z3::solver CoreSolver(Ctx);
+        z3::params Z3Params(Ctx);
+        // smaller cores are included in more queries
+        Z3Params.set("core.minimize", true);
+        if (SolverTimeOut.getValue() > 0) {
+            Z3Params.set("timeout", (unsigned) SolverTimeOut.getValue());
+        }
+        CoreSolver.set(Z3Params);
+
+        z3::expr_vector Trackers(Ctx);
+        std::unordered_map<unsigned, unsigned> TrackerIndex;
+        for (unsigned I = 0, E = Assertions.size(); I < E; I++) {
+            z3::expr Tracker(Ctx, Z3_mk_fresh_const(Ctx, "core_tracker", Ctx.bool_sort()));
+            CoreSolver.add(z3::implies(Tracker, Assertions[I]));
+            TrackerIndex[Z3_get_ast_id(Ctx, Tracker)] = I;
+            Trackers.push_back(Tracker);
+        }
+
+        if (CoreSolver.check(Trackers) != z3::check_result::unsat) {
+            return;
+        }
+        z3::expr_vector TrackerCore = CoreSolver.unsat_core();
+        z3::expr_vector Core(Ctx);
+        for (unsigned I = 0, E = TrackerCore.size(); I < E; I++) {
+            z3::expr Tracker = TrackerCore[I];
+            Core.push_back(Assertions[TrackerIndex.at(Z3_get_ast_id(Ctx, Tracker))]);
+        }
+        DEBUG(std::cerr << "Unsat core: " << Core.size() << "/" << Assertions.size() << "\n");
+        getSMTFactory().getUnsatCoreCache().insert(Core);
+        CoreRecorded = true;
+    } catch (z3::exception &Ex) {
+        std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+    }
+}
+
+void SMTSolver::collectZ3Statistics(const z3::solver& Z3Solver) {
+    if (!SMTTelemetry::enabled()) {
+        return;
+    }
+    // The statistics of the components of a sliced query are summed up.
+    z3::stats Stats = Z3Solver.statistics();
+    for (unsigned I = 0, N = Stats.size(); I < N; I++) {
+        std::string Key = Stats.key(I);
+        double Value = Stats.is_uint(I) ? (double) Stats.uint_value(I) : Stats.double_value(I);
+        auto It = std::find_if(Z3Statistics.begin(), Z3Statistics.end(),
+                [&Key](const std::pair<std::string, double>& KV) { return KV.first == Key; });
+        if (It == Z3Statistics.end()) {
+            Z3Statistics.push_back(std::make_pair(Key, Value));
+        } else {
+            It->second += Value;
+        }
+    }
+}
+
+z3::solver SMTSolver::newZ3Solver() {
+    z3::context& Ctx = Solver.ctx();
+    z3::solver Ret = Fork->Tactic.empty() ? z3::solver(Ctx) : z3::tactic(Ctx, Fork->Tactic.c_str()).mk_solver();
+    if (SolverTimeOut.getValue() > 0) {
+        z3::params Z3Params(Ctx);
+        Z3Params.set("timeout", (unsigned) SolverTimeOut.getValue());
+        Ret.set(Z3Params);
+    }
+    return Ret;
+}
+
+bool SMTSolver::eliminateVariables(const z3::expr_vector& Assertions, z3::solver& Reduced) {
+    if (!Elimination->eliminate(Assertions)) {
+        return false;
+    }
+
+    Reduced = Elimination->getReducedSolver([this]() {
+        return newZ3Solver();
+    });
+    DEBUG(std::cerr << "Variable elimination: " << Elimination->getReduced().size() << " assertions remain, "
+            << Elimination->getStatistics().Eliminated << " variables eliminated in total\n");
+    return true;
+}
+
+SMTSolver::SMTResultType SMTSolver::checkBackend() {
+    return checkBackend(Solver, Fragments->current());
+}
+
+SMTSolver::SMTResultType SMTSolver::checkBackend(z3::solver& Target, const SMTFragment& Fragment) {
+    auto Start = std::chrono::steady_clock::now();
+    SMTResultType Result = solveByBackend(Target, Fragment);
+    auto SolveTime = std::chrono::steady_clock::now() - Start;
+    getSMTFactory().getFragmentStatistics().record(Fragment, Result,
+            std::chrono::duration_cast<std::chrono::microseconds>(SolveTime).count(),
+            std::string(LastBackend) == "z3-logic");
+    return Result;
+}
+
+SMTSolver::SMTResultType SMTSolver::solveByBackend(z3::solver& Input, const SMTFragment& Fragment) {
+    // The backends below solve Target, which is Input or, if some
+    // variables are eliminated, a solver of the reduced assertions.
+    // The simplification solver and the incremental SMTLIB solver have
+    // their own copies of the assertions, which are not reduced.
+    z3::solver Target = Input;
+    z3::expr_vector Assertions = &Input == &Solver ? queryAssertions() : Input.assertions();
+    bool Eliminated = false;
+    if (Elimination && !UsingSimplify.getNumOccurrences() && !Mirror) {
+        try {
+            Eliminated = eliminateVariables(Assertions, Target);
+        } catch (z3::exception &Ex) {
+            std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+            Target = Input;
+        }
+    }
+    if (Eliminated) {
+        Assertions = Target.assertions();
+    }
+
     if (SMTConfig::UseSMTLIBSolver) {
         if (SMTConfig::UseIncrementalSMTLIBSolver) {
-            // FIXME: enable "true incrmental"
-            // NOTE: AssertionsCache is not used currently 
-            // std::string Query = this->Solver.decls_to_string() + join(AssertionsCache.getCacheVector()) +  + "(check-sat)\n";
-            std::string Query = "(set-logic QF_BV)\n" + this->Solver.to_smt2(); // slow
-            this->SmtlibSolver->reset(); // clear last query?
-            auto Result = SmtlibSolver->solveWholeFormula(Query);
+            LastBackend = "smtlib-incremental";
+            // The external solver mirrors the scopes of Solver, so only
+            // the assertions added since the last check are sent.
+            flushToSMTLIB();
+            auto Result = SmtlibSolver->check();
+            ReasonUnknown = SmtlibSolver->getReasonUnknown();
             if (Result == SMTLIBSolverResult::SMTRT_Sat) {
+                // the model is in the SMTLIB solver, not in Solver
+                ModelPending = true;
                 return SMTSolver::SMTResultType::SMTRT_Sat;
             } else if (Result == SMTLIBSolverResult::SMTRT_Unsat) {
                 return SMTSolver::SMTResultType::SMTRT_Unsat;
@@ -201,15 +1004,41 @@ SMTSolver::SMTResultType SMTSolver::check() {
                 return SMTSolver::SMTResultType::SMTRT_Unknown;
             }
         } else {
-            std::string Query = "(set-logic QF_BV)\n" + this->Solver.to_smt2(); // slow
-            auto dump_end = std::chrono::high_resolution_clock::now();
-
-            SmtlibSmtSolver* BinSolver = new SmtlibSmtSolver(SMTConfig::SMTLIBSolverPath, SMTConfig::SMTLIBSolverArgs);
-            // BinSolver->setLogic("QF_BV");
-            auto Result = BinSolver->solveWholeFormula(Query);
-            delete BinSolver;
+            LastBackend = "smtlib";
+            SMTLIBSolverResult Result;
+            if (SMTLIBPortfolio* Portfolio = SMTLIBPortfolio::get()) {
+                // the same text is sent to all members
+                LastBackend = "smtlib-portfolio";
+                std::string Query;
+                {
+                    SMTLIBWriter Writer(Query);
+                    Writer.command("(set-logic " + declaredLogic(Fragment) + ")");
+                    Writer.addAll(Assertions);
+                    Writer.command("(check-sat)");
+                }
+                Result = Portfolio->check(Query, ReasonUnknown);
+            } else {
+                // a warm process, which is reset and returned to the pool
+                // when the lease is destroyed
+                SMTLIBSolverPool::Lease BinSolver = SMTLIBSolverPool::get().checkout();
+                BinSolver->startQuery();
+                {
+                    // streamed to the solver, without the text of the whole query
+                    SmtlibSmtSolver* S = BinSolver.get();
+                    SMTLIBWriter Writer([S](const char* Data, size_t Size) {
+                        S->writeData(Data, Size);
+                    });
+                    Writer.command("(set-logic " + declaredLogic(Fragment) + ")");
+                    Writer.addAll(Assertions);
+                    Writer.command("(check-sat)");
+                }
+                Result = BinSolver->readCheckSatResult();
+                ReasonUnknown = BinSolver->getReasonUnknown();
+            }
 
             if (Result == SMTLIBSolverResult::SMTRT_Sat) {
+                // the model is in the SMTLIB solver, not in Solver
+                ModelPending = true;
                 return SMTSolver::SMTResultType::SMTRT_Sat;
             } else if (Result == SMTLIBSolverResult::SMTRT_Unsat) {
                 return SMTSolver::SMTResultType::SMTRT_Unsat;
@@ -220,84 +1049,108 @@ SMTSolver::SMTResultType SMTSolver::check() {
     }
 
     if (EnableSMTD.getNumOccurrences()) {
+        LastBackend = "smtd";
         std::string Contraints;
-        llvm::raw_string_ostream StringStream(Contraints);
-        StringStream << *((SMTSolver*)this);
+        {
+            SMTLIBWriter Writer(Contraints);
+            Writer.addAll(Assertions);
+            Writer.command("(check-sat)");
+        }
 
         // fault tolerance
-        while (-1 == Channels->WorkerMSQ->sendMessage(StringStream.str(), 1)) {
+        while (-1 == Channels->WorkerMSQ->sendMessage(Contraints, 1)) {
             reconnect();
         }
         std::string ResultString;
         while (-1 == Channels->WorkerMSQ->recvMessage(ResultString, 2)) {
             reconnect();
-            while (-1 == Channels->WorkerMSQ->sendMessage(StringStream.str(), 1)) {
+            while (-1 == Channels->WorkerMSQ->sendMessage(Contraints, 1)) {
                 reconnect();
             }
         }
 
         SMTResultType Result = (SMTResultType) std::stoi(ResultString);
+        ModelPending = Result == SMTRT_Sat;
         return Result;
     }
 
+    // The z3 solver of the fragment of -solver-route-by-logic, if any.
+    // An explicit tactic of the solver is kept.
+    std::string Z3Logic = RouteByLogic.getValue() && Fork->Tactic.empty() ? Fragment.getZ3Logic() : "";
+
     z3::check_result Result;
     try {
-        clock_t Start;
-        DEBUG(
-                std::cerr << "\nStart solving! Constraint Size: " << assertions().constraintSize() << "/" << assertions().size() << "\n"; Start = clock());
-        if (DumpingConstraintsTimeout.getNumOccurrences()) {
-            Start = clock();
-        }
+        SMTStopwatch Watch;
+        DEBUG(std::cerr << "\nStart solving! Constraint Size: " << assertions().constraintSize() << "/" << assertions().size() << "\n");
 
         if (UsingSimplify.getNumOccurrences()) {
-            z3::solver Z3Solver4Sim(Solver.ctx());
-
-            // 1. merge as one
-            SMTExpr Whole = this->assertions().toAndExpr();
-
-            // 2. simplify
-            if (UsingSimplify.getValue() == "local") {
-                Z3Solver4Sim.add(Whole.localSimplify().Expr);
-            } else if (UsingSimplify.getValue() == "dillig") {
-                SMTExpr SimplifiedForm = Whole.dilligSimplify();
-                // if (SimplifiedForm.equals(z3_solver.ctx().bool_val(false))) {
-                //		return SMTResult::UNSAT;
-                // } else {
-                //		if (debug_bug_report) {
-                //			// check so that get_model is valid
-                //			z3_solver.check();
-                //		}
-                //		return SMTResult::SAT;
-                // }
-                Z3Solver4Sim.add(SimplifiedForm.Expr);
-            } else {
-                Z3Solver4Sim.add(Whole.Expr);
+            LastBackend = "simplify";
+            Result = checkSimplified();
+            collectZ3Statistics(Simplification->Solver4Sim);
+            // the model is in the simplification solver, not in Solver
+            ModelPending = Result == z3::check_result::sat;
+        } else if (SMTPortfolio* Portfolio = SMTPortfolio::get()) {
+            LastBackend = "portfolio";
+            Result = Portfolio->check(Assertions,
+                    SolverTimeOut.getValue() > 0 ? (unsigned) SolverTimeOut.getValue() : 0, WitnessModel);
+            if (Eliminated && Result == z3::check_result::sat && WitnessModel) {
+                Elimination->reconstruct(*WitnessModel);
+            }
+        } else if (!Z3Logic.empty()) {
+            // The incremental solver uses the general SMT core once it
+            // has scopes, which is weak at nonlinear arithmetic.
+            LastBackend = "z3-logic";
+            z3::solver Routed(Input.ctx(), Z3Logic.c_str());
+            if (SolverTimeOut.getValue() > 0) {
+                z3::params Z3Params(Input.ctx());
+                Z3Params.set("timeout", (unsigned) SolverTimeOut.getValue());
+                Routed.set(Z3Params);
+            }
+            for (unsigned I = 0, E = Assertions.size(); I < E; I++) {
+                Routed.add(Assertions[I]);
+            }
+            Result = Routed.check();
+            collectZ3Statistics(Routed);
+            if (Result == z3::check_result::sat) {
+                // the model is in Routed, not in Solver
+                WitnessModel = std::make_shared<z3::model>(Routed.get_model());
+                if (Eliminated) {
+                    Elimination->reconstruct(*WitnessModel);
+                }
+            } else if (Result == z3::check_result::unknown) {
+                ReasonUnknown = Routed.reason_unknown();
             }
-
-            DEBUG(std::cerr << "Simplifying Done: (" << (double)(clock() - Start) * 1000 / CLOCKS_PER_SEC << ")\n");
-
-            Result = Z3Solver4Sim.check();
         } else {
-            Result = Solver.check();
+            // The guards of checkAssuming() in Solver do not change the
+            // result, since their indicator literals are free.
+            LastBackend = "z3";
+            Result = Target.check();
+            collectZ3Statistics(Target);
+            if (Eliminated && Result == z3::check_result::sat) {
+                // the model of Target lacks the eliminated variables
+                WitnessModel = std::make_shared<z3::model>(Target.get_model());
+                Elimination->reconstruct(*WitnessModel);
+            }
         }
 
         if (DumpingConstraintsTimeout.getNumOccurrences()) {
-            double TimeCost = (double) (clock() - Start) * 1000 / CLOCKS_PER_SEC;
-            if (TimeCost > DumpingConstraintsTimeout.getValue() && DumpingConstraintsDst.getNumOccurrences()) {
-                // output the constraints to a temp file in the dst
-                std::string DstFileName = DumpingConstraintsDst.getValue();
-                DstFileName.append("/case");
-                DstFileName.append(std::to_string(clock()));
-                DstFileName.append(".smt2");
-
-                std::ofstream DstFile;
-                DstFile.open(DstFileName);
-
-                if (DstFile.is_open()) {
-                    DstFile << *this << "\n";
-                    DstFile.close();
-                } else {
-                    std::cerr << "File cannot be opened: " << DstFileName << "\n";
+            double TimeCost = Watch.getWallTimeUs() / 1000.0;
+            SMTDumpWriter* Writer = SMTDumpWriter::get();
+            if (TimeCost > DumpingConstraintsTimeout.getValue() && Writer) {
+                // Only the serialization is done here, and the
+                // file is written by the background writer.
+                SMTFingerprint Fingerprint = SMTFingerprint::of(Assertions);
+                if (Writer->claim(Fingerprint)) {
+                    SMTResultType DumpResult = Result == z3::check_result::sat ? SMTRT_Sat
+                            : (Result == z3::check_result::unsat ? SMTRT_Unsat : SMTRT_Unknown);
+                    std::string Query;
+                    {
+                        SMTLIBWriter QueryWriter(Query);
+                        QueryWriter.addAll(Assertions);
+                        QueryWriter.command("(check-sat)");
+                    }
+                    Writer->submit(Fingerprint, std::move(Query), Watch.getWallTimeUs(),
+                            SolverTimeOut.getValue() > 0 ? (unsigned) SolverTimeOut.getValue() : 0, DumpResult);
                 }
 
                 SMTSolvingTimeOut = true;
@@ -306,10 +1159,11 @@ SMTSolver::SMTResultType SMTSolver::check() {
             }
             DEBUG(std::cerr << "Solving done: (" << TimeCost << ", " << Result << ")\n");
         } else {
-            DEBUG(std::cerr << "Solving done: (" << (double)(clock() - Start) * 1000 / CLOCKS_PER_SEC << ", " << Result << ")\n");
+            DEBUG(std::cerr << "Solving done: (" << Watch.getWallTimeUs() / 1000.0 << ", " << Result << ")\n");
         }
     } catch (z3::exception &Ex) {
         std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+        ReasonUnknown = Ex.msg();
         return SMTResultType::SMTRT_Unknown;
     }
 
@@ -324,7 +1178,9 @@ SMTSolver::SMTResultType SMTSolver::check() {
         RetVal = SMTResultType::SMTRT_Unsat;
         break;
     case z3::check_result::unknown:
-        // std::cout << Solver.reason_unknown() << "\n";
+        if (std::string(LastBackend) == "z3") {
+            ReasonUnknown = Target.reason_unknown();
+        }
         RetVal = SMTResultType::SMTRT_Unknown;
         break;
     }
@@ -332,8 +1188,15 @@ SMTSolver::SMTResultType SMTSolver::check() {
 }
 
 void SMTSolver::push() {
+    Fork->Head = std::make_shared<const TrailNode>(Fork->Head, true, Solver.ctx().bool_val(true));
+    if (!Fork->Materialized) {
+        return;
+    }
+
     try {
-        Solver.push();
+        // the buffered constraints belong to the outer scope
+        materialize();
+        pushNow();
     } catch (z3::exception &Ex) {
         std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
         exit(1);
@@ -341,12 +1204,35 @@ void SMTSolver::push() {
 }
 
 void SMTSolver::pop(unsigned N) {
+    for (unsigned I = 0; I < N; I++) {
+        while (Fork->Head && !Fork->Head->IsPush) {
+            Fork->Head = Fork->Head->Parent;
+        }
+        assert(Fork->Head && "Popping more scopes than pushed!");
+        Fork->Head = Fork->Head->Parent;
+    }
+    if (!Fork->Materialized) {
+        return;
+    }
+
     try {
+        if (Buffer) {
+            Buffer->pop(N);
+        }
         Solver.pop(N);
-        //if (SMTConfig::UseIncrementalSMTLIBSolver) {
-            // explicitly maintain the assertion stacks
-        //    AssertionsCache.pop(N);
-        //}
+        Fragments->pop(N);
+        Assumptions->popTo(getNumScopes());
+        if (Simplification) {
+            Simplification->Added.pop(N);
+            Simplification->Solver4Sim.pop(N);
+        }
+        if (Mirror) {
+            // the unsent assertions of the popped scopes are dropped
+            Mirror->pop(N);
+            if (Mirror->Generation == SmtlibSolver->getGeneration()) {
+                SmtlibSolver->pop(N);
+            }
+        }
     } catch (z3::exception &Ex) {
         std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
         exit(1);
@@ -354,6 +1240,7 @@ void SMTSolver::pop(unsigned N) {
 }
 
 unsigned SMTSolver::getNumScopes() {
+    materialize();
     return Z3_solver_get_num_scopes(Solver.ctx(), Solver);
 }
 
@@ -362,15 +1249,24 @@ void SMTSolver::add(SMTExpr E) {
         return;
     }
 
+    if (Buffer && Fork->Materialized) {
+        // added to the z3 solver by the next materialize()
+        if (Buffer->record(E.Expr)) {
+            Fork->Head = std::make_shared<const TrailNode>(Fork->Head, false, E.Expr);
+            Buffer->Pending.push_back(E.Expr);
+        }
+        return;
+    }
+
+    Fork->Head = std::make_shared<const TrailNode>(Fork->Head, false, E.Expr);
+    if (!Fork->Materialized) {
+        return;
+    }
+
     try {
         // FIXME In some cases (ar._bfd_elf_parse_eh_frame.bc),
         // simplify() will seriously affect the performance.
-        Solver.add(E.Expr/*.simplify()*/);
-
-    	//if (SMTConfig::UseIncrementalSMTLIBSolver) {
-        //    std::string Cnt = "(assert " + E.Expr.to_string() + ")";
-        //    AssertionsCache.add(Cnt + "\n");
-    	//}
+        assertNow(E.Expr/*.simplify()*/);
     } catch (z3::exception &Ex) {
         std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
         exit(1);
@@ -384,7 +1280,7 @@ void SMTSolver::addAll(SMTExprVec EVec) {
     // 2. Call toAnd(EVec), and add the returned formula
     // 3. Call toAnd(EVec), add add a simplified version of the returned formula
     // 4. Take the size of EVec into considerations; choose the parameters of simplify()
-    if (EnableLocalSimplify.getValue()) {
+    if (EnableLocalSimplify.getValue() && !Buffer) {
         add(EVec.toAndExpr());
         // Turn EVec to a single Expr, and call simplify()
         //Solver.add(EVec.toAndExpr().Expr.simplify());
@@ -403,25 +1299,336 @@ void SMTSolver::addAll(const std::vector<SMTExpr>& EVec) {
 }
 
 SMTExprVec SMTSolver::assertions() {
-    std::shared_ptr<z3::expr_vector> Vec = std::make_shared<z3::expr_vector>(Solver.assertions());
+    materialize();
+    std::shared_ptr<z3::expr_vector> Vec = std::make_shared<z3::expr_vector>(queryAssertions());
     return SMTExprVec(&getSMTFactory(), Vec);
 }
 
 void SMTSolver::reset() {
-    // TODO: should we send "reset" or "reset-assertions" to the SMTLIB solver
     Solver.reset();
-    //if (SMTConfig::UseIncrementalSMTLIBSolver) {
-    //     AssertionsCache.reset();
-    //}
+    Fragments->reset();
+    Fork->Head.reset();
+    Fork->Materialized = true;
+    if (Buffer) {
+        Buffer->reset();
+    }
+    Assumptions->popTo(0);
+    Assumptions->Indicators.clear();
+    if (Simplification) {
+        Simplification->Added.reset();
+        Simplification->Solver4Sim.reset();
+    }
+    if (Mirror) {
+        // the logic is declared again by the next flushToSMTLIB()
+        Mirror->reset();
+        SmtlibSolver->reset();
+    }
 }
 
 bool SMTSolver::operator<(const SMTSolver& Solver) const {
     return ((Z3_solver) this->Solver) < ((Z3_solver) Solver.Solver);
 }
 
+SMTSolver SMTSolver::fork() {
+    SMTSolver Ret = getSMTFactory().createSMTSolverWithTactic(Fork->Tactic);
+    Ret.Fork->Head = Fork->Head;
+    Ret.Fork->Materialized = Fork->Head == nullptr;
+    return Ret;
+}
+
+void SMTSolver::setTacticName(const std::string& Tactic) {
+    Fork->Tactic = Tactic;
+}
+
+void SMTSolver::materialize() {
+    if (!Fork->Materialized) {
+        replayTrail();
+    }
+
+    if (Buffer && !Buffer->Pending.empty()) {
+        try {
+            for (auto& E : Buffer->Pending) {
+                assertNow(E);
+            }
+        } catch (z3::exception &Ex) {
+            std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+            exit(1);
+        }
+        Buffer->Pending.clear();
+    }
+}
+
+void SMTSolver::assertNow(const z3::expr& E) {
+    Solver.add(E);
+    Fragments->add(E);
+    if (Simplification) {
+        Simplification->Added.add(E);
+    }
+    if (Mirror) {
+        Mirror->Added.add(E);
+    }
+}
+
+void SMTSolver::pushNow() {
+    Solver.push();
+    Fragments->push();
+    if (Simplification) {
+        // the unsimplified assertions belong to the outer scope
+        flushToSimplification();
+        Simplification->Added.push();
+        Simplification->Solver4Sim.push();
+    }
+    if (Buffer) {
+        Buffer->push();
+    }
+    if (Mirror) {
+        // the unsent assertions belong to the outer scope
+        flushToSMTLIB();
+        Mirror->push();
+        SmtlibSolver->push(1);
+    }
+}
+
+void SMTSolver::flushToSMTLIB() {
+    // the process is restarted (e.g. after missing a deadline)
+    // and has lost the assertions
+    bool Resend = Mirror->Generation != SmtlibSolver->getGeneration();
+
+    // The logic is declared before anything is sent. If the new
+    // assertions are out of it, the solver is reset to declare a
+    // wider logic, and everything is sent again.
+    SMTFragment Wider(Mirror->Declared.getFeatures() | Fragments->current().getFeatures());
+    std::string Logic = declaredLogic(Wider);
+    if (Logic != Mirror->Logic) {
+        if (!Mirror->Logic.empty()) {
+            SmtlibSolver->reset();
+            Resend = true;
+        }
+        SmtlibSolver->setLogic(Logic);
+        Mirror->Logic = Logic;
+    }
+    Mirror->Declared = Wider;
+
+    if (Resend) {
+        Mirror->Generation = SmtlibSolver->getGeneration();
+        Mirror->resend(*SmtlibSolver);
+        return;
+    }
+    Mirror->sendDelta();
+}
+
+void SMTSolver::replayTrail() {
+    std::vector<const TrailNode*> Nodes;
+    for (const TrailNode* N = Fork->Head.get(); N; N = N->Parent.get()) {
+        Nodes.push_back(N);
+    }
+
+    try {
+        for (auto It = Nodes.rbegin(), E = Nodes.rend(); It != E; ++It) {
+            if ((*It)->IsPush) {
+                pushNow();
+            } else if (!Buffer || Buffer->record((*It)->Expr)) {
+                assertNow((*It)->Expr);
+            }
+        }
+    } catch (z3::exception &Ex) {
+        std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+        exit(1);
+    }
+    Fork->Materialized = true;
+}
+
+SMTCheckFuture SMTSolver::checkAsync() {
+    return SMTCheckFuture::launch(this, Solver.ctx());
+}
+
+z3::expr_vector SMTSolver::queryAssertions() {
+    z3::expr_vector All = Solver.assertions();
+    if (Assumptions->Indicators.empty()) {
+        return All;
+    }
+
+    std::unordered_set<unsigned> Literals = Assumptions->literalIds();
+    z3::expr_vector Ret(Solver.ctx());
+    for (unsigned I = 0, E = All.size(); I < E; I++) {
+        z3::expr A = All[I];
+        bool IsGuard = A.is_app() && A.decl().decl_kind() == Z3_OP_IMPLIES
+                && Literals.count(Z3_get_ast_id(A.ctx(), A.arg(0)));
+        if (!IsGuard) {
+            Ret.push_back(A);
+        }
+    }
+    return Ret;
+}
+
+z3::model SMTSolver::getZ3Model() {
+    z3::model Model = Solver.get_model();
+    if (Assumptions->Indicators.empty()) {
+        return Model;
+    }
+
+    std::unordered_set<unsigned> Literals = Assumptions->literalIds();
+    z3::model Ret(Solver.ctx());
+    mergeModel(Ret, Model, &Literals);
+    return Ret;
+}
+
+SMTSolver::SMTResultType SMTSolver::checkAssuming(SMTExprVec Assumed) {
+    materialize();
+    ModelPending = false;
+    WitnessModel.reset();
+    Assumptions->Core.clear();
+    Assumptions->CoreMinimized = false;
+
+    if (Buffer && Buffer->Conflict) {
+        // the assertions alone are unsat, so the core is empty
+        Assumptions->CoreMinimized = true;
+        return SMTRT_Unsat;
+    }
+
+    if (SMTConfig::UseSMTLIBSolver || EnableSMTD.getNumOccurrences()) {
+        // The external backends have no assumptions, so use a scope instead.
+        // The whole set of assumptions is the core.
+        push();
+        addAll(Assumed);
+        SMTResultType Result = check();
+        pop();
+        if (Result == SMTRT_Unsat) {
+            for (unsigned I = 0; I < Assumed.size(); I++) {
+                z3::expr A = Assumed[I].Expr;
+                Assumptions->Core.push_back(std::make_pair(A, A));
+            }
+            // it cannot be minimized without assumptions
+            Assumptions->CoreMinimized = true;
+        }
+        return Result;
+    }
+
+    LastBackend = "z3-assuming";
+    z3::check_result Result;
+    std::vector<std::pair<z3::expr, z3::expr>> Used;
+    try {
+        z3::context& Ctx = Solver.ctx();
+        z3::expr_vector Literals(Ctx);
+        unsigned Level = getNumScopes();
+        for (unsigned I = 0; I < Assumed.size(); I++) {
+            z3::expr A = Assumed[I].Expr;
+            if (A.is_true()) {
+                continue;
+            }
+
+            unsigned Id = Z3_get_ast_id(Ctx, A);
+            auto It = Assumptions->Indicators.find(Id);
+            if (It == Assumptions->Indicators.end()) {
+                z3::expr Literal = z3::to_expr(Ctx, Z3_mk_fresh_const(Ctx, "assume", Ctx.bool_sort()));
+                // The guard is kept out of Fragments, which decides the
+                // logic of later queries, since they do not include it.
+                Solver.add(z3::implies(Literal, A));
+                It = Assumptions->Indicators.insert(std::make_pair(Id,
+                        AssumptionState::Indicator{A, Literal, Level})).first;
+            }
+            Literals.push_back(It->second.Literal);
+            Used.push_back(std::make_pair(It->second.Literal, A));
+        }
+
+        Result = Solver.check(Literals);
+        if (Result == z3::check_result::unsat) {
+            Assumptions->Core = coreOf(Used);
+        }
+    } catch (z3::exception &Ex) {
+        std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+        return SMTRT_Unknown;
+    }
+
+    switch (Result) {
+    case z3::check_result::sat:
+        return SMTRT_Sat;
+    case z3::check_result::unsat:
+        return SMTRT_Unsat;
+    default:
+        return SMTRT_Unknown;
+    }
+}
+
+std::vector<std::pair<z3::expr, z3::expr>> SMTSolver::coreOf(const std::vector<std::pair<z3::expr, z3::expr>>& Used) {
+    std::unordered_set<unsigned> CoreIds;
+    z3::expr_vector Z3Core = Solver.unsat_core();
+    for (unsigned I = 0; I < Z3Core.size(); I++) {
+        CoreIds.insert(Z3_get_ast_id(Solver.ctx(), Z3Core[I]));
+    }
+
+    std::vector<std::pair<z3::expr, z3::expr>> Core;
+    for (auto& LA : Used) {
+        if (CoreIds.count(Z3_get_ast_id(Solver.ctx(), LA.first))) {
+            Core.push_back(LA);
+        }
+    }
+    return Core;
+}
+
+SMTExprVec SMTSolver::getUnsatCore(bool Minimize) {
+    std::vector<std::pair<z3::expr, z3::expr>>& Core = Assumptions->Core;
+    if (Minimize && !Assumptions->CoreMinimized) {
+        try {
+            // deletion-based minimization: drop an assumption if
+            // the others are still unsat, and shrink to their core
+            for (size_t I = 0; I < Core.size();) {
+                std::vector<std::pair<z3::expr, z3::expr>> Rest;
+                z3::expr_vector Literals(Solver.ctx());
+                for (size_t J = 0; J < Core.size(); J++) {
+                    if (J != I) {
+                        Rest.push_back(Core[J]);
+                        Literals.push_back(Core[J].first);
+                    }
+                }
+                if (Solver.check(Literals) != z3::check_result::unsat) {
+                    I++;
+                    continue;
+                }
+
+                // The assumptions before I are necessary, so they are in
+                // any core of Rest, at the same positions.
+                Core = coreOf(Rest);
+            }
+            Assumptions->CoreMinimized = true;
+        } catch (z3::exception &Ex) {
+            std::cerr << __FILE__ << " : " << __LINE__ << " : " << Ex << "\n";
+        }
+    }
+
+    SMTExprVec Ret = getSMTFactory().createEmptySMTExprVec();
+    for (auto& LA : Core) {
+        Ret.push_back(SMTExpr(&getSMTFactory(), LA.second));
+    }
+    return Ret;
+}
+
 SMTModel SMTSolver::getSMTModel() {
+    materialize();
     try {
-        return SMTModel(&getSMTFactory(), Solver.get_model());
+        if (WitnessModel && UnmodeledAssertions) {
+            // the components of a sliced query without models
+            z3::solver ComponentSolver = newZ3Solver();
+            for (unsigned I = 0, E = UnmodeledAssertions->size(); I < E; I++) {
+                ComponentSolver.add((*UnmodeledAssertions)[I]);
+            }
+            if (ComponentSolver.check() != z3::check_result::sat) {
+                // a partial model would leave their variables unassigned
+                throw z3::exception(("cannot complete the model of the sliced query: "
+                        + ComponentSolver.reason_unknown()).c_str());
+            }
+            mergeModel(*WitnessModel, ComponentSolver.get_model());
+            UnmodeledAssertions.reset();
+        }
+        if (WitnessModel) {
+            return SMTModel(&getSMTFactory(), *WitnessModel);
+        }
+        if (ModelPending) {
+            // the result came from a cache, so solve it to get a model
+            Solver.check();
+            ModelPending = false;
+        }
+        return SMTModel(&getSMTFactory(), getZ3Model());
     } catch (z3::exception & e) {
         std::cerr << __FILE__ << " : " << __LINE__ << " : " << e << "\n";
         exit(1);
@@ -0,0 +1,262 @@
+/**
+ * Per-query telemetry of the solvers of a factory.
+ */
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+
+#include <time.h>
+#include <unordered_set>
+
+#include "SMT/SMTTelemetry.h"
+
+static llvm::cl::opt<bool> EnableTelemetry("solver-telemetry", llvm::cl::init(false),
+        llvm::cl::desc("Record the time, size, backend and result of each query in the telemetry of its factory"));
+
+static llvm::cl::opt<unsigned> TelemetryRecords("solver-telemetry-records", llvm::cl::init(1 << 16),
+        llvm::cl::desc("Keep at most this number of recent queries per factory for exporting the telemetry"));
+
+static const char* ResultNames[] = { "unsat", "sat", "unknown", "uncheck" };
+
+static uint64_t threadCPUTimeUs() {
+	struct timespec TS;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &TS) != 0) {
+		return 0;
+	}
+	return (uint64_t) TS.tv_sec * 1000000 + TS.tv_nsec / 1000;
+}
+
+SMTStopwatch::SMTStopwatch() :
+		WallStart(std::chrono::steady_clock::now()), CPUStartUs(threadCPUTimeUs()) {
+}
+
+uint64_t SMTStopwatch::getWallTimeUs() const {
+	auto Time = std::chrono::steady_clock::now() - WallStart;
+	return std::chrono::duration_cast<std::chrono::microseconds>(Time).count();
+}
+
+uint64_t SMTStopwatch::getThreadCPUTimeUs() const {
+	return threadCPUTimeUs() - CPUStartUs;
+}
+
+unsigned SMTLatencyHistogram::bucketOf(uint64_t Us) {
+	if (Us < 4) {
+		return (unsigned) Us;
+	}
+	unsigned Log = 63 - __builtin_clzll(Us);
+	unsigned Sub = (unsigned) (Us >> (Log - 2)) & 3;
+	return 4 * (Log - 1) + Sub;
+}
+
+uint64_t SMTLatencyHistogram::upperBoundOf(unsigned Bucket) {
+	if (Bucket < 4) {
+		return Bucket;
+	}
+	unsigned Log = Bucket / 4 + 1, Sub = Bucket % 4;
+	uint64_t Lower = (uint64_t) (4 + Sub) << (Log - 2);
+	return Lower + ((uint64_t) 1 << (Log - 2)) - 1;
+}
+
+void SMTLatencyHistogram::add(uint64_t Us) {
+	unsigned Bucket = bucketOf(Us);
+	if (Bucket >= Buckets.size()) {
+		Buckets.resize(Bucket + 1, 0);
+	}
+	Buckets[Bucket]++;
+	Count++;
+	Total += Us;
+	if (Us > Max) {
+		Max = Us;
+	}
+}
+
+uint64_t SMTLatencyHistogram::percentile(double P) const {
+	if (Count == 0) {
+		return 0;
+	}
+	uint64_t Rank = (uint64_t) (P * (Count - 1)) + 1, Seen = 0;
+	for (unsigned I = 0; I < Buckets.size(); I++) {
+		Seen += Buckets[I];
+		if (Seen >= Rank) {
+			uint64_t Bound = upperBoundOf(I);
+			return Bound < Max ? Bound : Max;
+		}
+	}
+	return Max;
+}
+
+bool SMTTelemetry::enabled() {
+	return EnableTelemetry.getValue();
+}
+
+unsigned SMTTelemetry::dagSize(const z3::expr_vector& Assertions) {
+	Z3_context Ctx = Assertions.ctx();
+	std::unordered_set<unsigned> Visited;
+	std::vector<Z3_ast> Worklist;
+	for (unsigned I = 0, N = Assertions.size(); I < N; I++) {
+		Worklist.push_back(Assertions[I]);
+	}
+
+	// The exprs are kept alive by the assertions, so their ids are stable.
+	while (!Worklist.empty()) {
+		Z3_ast Node = Worklist.back();
+		Worklist.pop_back();
+		if (!Visited.insert(Z3_get_ast_id(Ctx, Node)).second) {
+			continue;
+		}
+
+		switch (Z3_get_ast_kind(Ctx, Node)) {
+		case Z3_APP_AST: {
+			Z3_app App = Z3_to_app(Ctx, Node);
+			for (unsigned I = 0, N = Z3_get_app_num_args(Ctx, App); I < N; I++) {
+				Worklist.push_back(Z3_get_app_arg(Ctx, App, I));
+			}
+			break;
+		}
+		case Z3_QUANTIFIER_AST:
+			Worklist.push_back(Z3_get_quantifier_body(Ctx, Node));
+			break;
+		default:
+			break;
+		}
+	}
+	return (unsigned) Visited.size();
+}
+
+void SMTTelemetry::record(QueryRecord R) {
+	std::lock_guard<std::mutex> L(TelemetryLock);
+	for (Summary* S : { &Total, &Tags[R.Tag] }) {
+		S->Results[R.Result]++;
+		S->Backends[R.Backend]++;
+		S->WallTime.add(R.WallTimeUs);
+		S->CPUTime.add(R.CPUTimeUs);
+	}
+
+	if (TelemetryRecords.getValue() == 0) {
+		return;
+	}
+	Records.push_back(std::move(R));
+	while (Records.size() > TelemetryRecords.getValue()) {
+		Records.pop_front();
+	}
+}
+
+SMTTelemetry::Summary SMTTelemetry::getSummary() {
+	std::lock_guard<std::mutex> L(TelemetryLock);
+	return Total;
+}
+
+std::map<std::string, SMTTelemetry::Summary> SMTTelemetry::getTagSummaries() {
+	std::lock_guard<std::mutex> L(TelemetryLock);
+	return Tags;
+}
+
+std::vector<SMTTelemetry::QueryRecord> SMTTelemetry::getRecords() {
+	std::lock_guard<std::mutex> L(TelemetryLock);
+	return std::vector<QueryRecord>(Records.begin(), Records.end());
+}
+
+void SMTTelemetry::clear() {
+	std::lock_guard<std::mutex> L(TelemetryLock);
+	Total = Summary();
+	Tags.clear();
+	Records.clear();
+}
+
+/// JSON escapes quotes by backslashes, and CSV by doubling them.
+static void writeQuoted(llvm::raw_ostream& O, const std::string& Str, bool CSV = false) {
+	O << '"';
+	for (char C : Str) {
+		if ((unsigned char) C < 0x20 && !CSV) {
+			// JSON strings cannot contain control characters, which
+			// may be in the tags set by the users, e.g. line breaks
+			O << llvm::format("\\u%04x", (unsigned) C);
+			continue;
+		} else if (C == '"') {
+			O << (CSV ? '"' : '\\');
+		} else if (C == '\\' && !CSV) {
+			O << '\\';
+		}
+		O << C;
+	}
+	O << '"';
+}
+
+static void writeHistogramJSON(llvm::raw_ostream& O, const SMTLatencyHistogram& H) {
+	O << "{\"count\": " << H.count() << ", \"total_us\": " << H.total() << ", \"p50_us\": " << H.percentile(0.5)
+			<< ", \"p99_us\": " << H.percentile(0.99) << ", \"max_us\": " << H.max() << "}";
+}
+
+static void writeSummaryJSON(llvm::raw_ostream& O, const SMTTelemetry::Summary& S) {
+	O << "{\"results\": {";
+	for (unsigned I = 0; I < 4; I++) {
+		O << (I ? ", " : "") << "\"" << ResultNames[I] << "\": " << S.Results[I];
+	}
+	O << "}, \"backends\": {";
+	bool First = true;
+	for (auto& It : S.Backends) {
+		O << (First ? "" : ", ");
+		writeQuoted(O, It.first);
+		O << ": " << It.second;
+		First = false;
+	}
+	O << "}, \"wall_time\": ";
+	writeHistogramJSON(O, S.WallTime);
+	O << ", \"cpu_time\": ";
+	writeHistogramJSON(O, S.CPUTime);
+	O << "}";
+}
+
+void SMTTelemetry::writeJSON(llvm::raw_ostream& O) {
+	std::lock_guard<std::mutex> L(TelemetryLock);
+	O << "{\n\"total\": ";
+	writeSummaryJSON(O, Total);
+	O << ",\n\"tags\": {";
+	bool First = true;
+	for (auto& It : Tags) {
+		O << (First ? "\n" : ",\n");
+		writeQuoted(O, It.first);
+		O << ": ";
+		writeSummaryJSON(O, It.second);
+		First = false;
+	}
+	O << "},\n\"queries\": [";
+	First = true;
+	for (auto& R : Records) {
+		O << (First ? "\n" : ",\n") << "{\"tag\": ";
+		writeQuoted(O, R.Tag);
+		O << ", \"backend\": ";
+		writeQuoted(O, R.Backend);
+		O << ", \"result\": \"" << ResultNames[R.Result] << "\", \"wall_us\": " << R.WallTimeUs << ", \"cpu_us\": "
+				<< R.CPUTimeUs << ", \"assertions\": " << R.NumAssertions << ", \"dag_size\": " << R.DagSize
+				<< ", \"z3_stats\": {";
+		for (unsigned I = 0; I < R.Z3Statistics.size(); I++) {
+			O << (I ? ", " : "");
+			writeQuoted(O, R.Z3Statistics[I].first);
+			O << ": " << llvm::format("%.15g", R.Z3Statistics[I].second);
+		}
+		O << "}}";
+		First = false;
+	}
+	O << "]\n}\n";
+}
+
+void SMTTelemetry::writeCSV(llvm::raw_ostream& O) {
+	std::lock_guard<std::mutex> L(TelemetryLock);
+	O << "tag,backend,result,wall_us,cpu_us,assertions,dag_size,z3_stats\n";
+	for (auto& R : Records) {
+		writeQuoted(O, R.Tag, true);
+		O << ",";
+		writeQuoted(O, R.Backend, true);
+		O << "," << ResultNames[R.Result] << "," << R.WallTimeUs << "," << R.CPUTimeUs << "," << R.NumAssertions << ","
+				<< R.DagSize << ",";
+		std::string Stats;
+		llvm::raw_string_ostream StatsStream(Stats);
+		for (unsigned I = 0; I < R.Z3Statistics.size(); I++) {
+			StatsStream << (I ? ";" : "") << R.Z3Statistics[I].first << "=" << llvm::format("%.15g", R.Z3Statistics[I].second);
+		}
+		StatsStream.flush();
+		writeQuoted(O, Stats, true);
+		O << "\n";
+	}
+}
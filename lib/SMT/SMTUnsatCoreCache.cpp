@@ -0,0 +1,128 @@
+/**
+ * A cache of unsat cores for subset-based unsat detection.
+ */
+
+#include <algorithm>
+
+#include "SMT/SMTUnsatCoreCache.h"
+
+SMTUnsatCoreCache::SMTUnsatCoreCache(size_t Cap) : Capacity(Cap) {
+}
+
+std::vector<unsigned> SMTUnsatCoreCache::sortedIds(const z3::expr_vector& Exprs) {
+	std::vector<unsigned> Ids;
+	Ids.reserve(Exprs.size());
+	for (unsigned I = 0, E = Exprs.size(); I < E; I++) {
+		z3::expr A = Exprs[I];
+		if (A.is_true()) {
+			continue;
+		}
+		Ids.push_back(Z3_get_ast_id(A.ctx(), A));
+	}
+	std::sort(Ids.begin(), Ids.end());
+	Ids.erase(std::unique(Ids.begin(), Ids.end()), Ids.end());
+	return Ids;
+}
+
+bool SMTUnsatCoreCache::search(const TrieNode& Node, const std::vector<unsigned>& Ids, size_t From) {
+	if (Node.Terminal) {
+		return true;
+	}
+
+	// Labels along a path are increasing, thus only Ids[From..] matter.
+	// Walk the smaller one of the children and the remaining ids.
+	if (Node.Children.size() <= Ids.size() - From) {
+		for (auto& Child : Node.Children) {
+			auto It = std::lower_bound(Ids.begin() + From, Ids.end(), Child.first);
+			if (It == Ids.end()) {
+				break;
+			}
+			if (*It == Child.first && search(*Child.second, Ids, It - Ids.begin() + 1)) {
+				return true;
+			}
+		}
+	} else {
+		for (size_t I = From; I < Ids.size(); I++) {
+			auto It = Node.Children.find(Ids[I]);
+			if (It != Node.Children.end() && search(*It->second, Ids, I + 1)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+size_t SMTUnsatCoreCache::countCores(const TrieNode& Node) {
+	if (Node.Terminal) {
+		return 1;
+	}
+	size_t Ret = 0;
+	for (auto& Child : Node.Children) {
+		Ret += countCores(*Child.second);
+	}
+	return Ret;
+}
+
+bool SMTUnsatCoreCache::containsCoreOf(const z3::expr_vector& Assertions) {
+	if (!enabled() || NumCores == 0) {
+		return false;
+	}
+
+	if (search(Root, sortedIds(Assertions), 0)) {
+		Stats.Hits++;
+		return true;
+	}
+	Stats.Misses++;
+	return false;
+}
+
+void SMTUnsatCoreCache::insert(const z3::expr_vector& Core) {
+	if (!enabled()) {
+		return;
+	}
+
+	std::vector<unsigned> Ids = sortedIds(Core);
+	if (Ids.empty()) {
+		// "true" is not unsat, something must be wrong
+		return;
+	}
+
+	if (NumCores >= Capacity) {
+		clear();
+		Stats.Flushes++;
+	}
+
+	TrieNode* Node = &Root;
+	for (unsigned Id : Ids) {
+		if (Node->Terminal) {
+			// a subset of the core has been recorded
+			return;
+		}
+		std::unique_ptr<TrieNode>& Child = Node->Children[Id];
+		if (!Child) {
+			Child.reset(new TrieNode());
+		}
+		Node = Child.get();
+	}
+
+	if (Node->Terminal) {
+		return;
+	}
+	// supersets of this core are useless from now on, and their
+	// exprs are released with their nodes
+	NumCores -= countCores(*Node);
+	Node->Terminal = true;
+	Node->Children.clear();
+
+	for (unsigned I = 0, E = Core.size(); I < E; I++) {
+		Node->Pinned.push_back(Core[I]);
+	}
+	NumCores++;
+	Stats.Cores++;
+}
+
+void SMTUnsatCoreCache::clear() {
+	Root.Terminal = false;
+	Root.Children.clear();
+	NumCores = 0;
+}
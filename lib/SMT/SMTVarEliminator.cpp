@@ -0,0 +1,271 @@
+/**
+ * Variable elimination of the solved-form equalities in a query.
+ */
+
+#include <unordered_set>
+
+#include "SMT/SMTVarEliminator.h"
+
+static unsigned idOf(const z3::expr& N) {
+	return Z3_get_ast_id(N.ctx(), N);
+}
+
+static bool isVariable(const z3::expr& N) {
+	return N.is_app() && N.num_args() == 0 && N.decl().decl_kind() == Z3_OP_UNINTERPRETED;
+}
+
+static bool isKind(const z3::expr& N, Z3_decl_kind Kind) {
+	return N.is_app() && N.decl().decl_kind() == Kind;
+}
+
+SMTVarEliminator::SMTVarEliminator(z3::context& C) : Ctx(C), Vars(C), Defs(C), Reduced(C), CachedVars(C),
+		CachedDefs(C) {
+}
+
+bool SMTVarEliminator::solvedForm(const z3::expr& E, z3::expr& Var, z3::expr& Def) {
+	if (isVariable(E) && E.is_bool()) {
+		Var = E;
+		Def = Ctx.bool_val(true);
+		return true;
+	} else if (isKind(E, Z3_OP_NOT) && isVariable(E.arg(0))) {
+		Var = E.arg(0);
+		Def = Ctx.bool_val(false);
+		return true;
+	} else if (isKind(E, Z3_OP_EQ) && E.num_args() == 2) {
+		// prefer the side that is not a variable as the definition
+		z3::expr L = E.arg(0), R = E.arg(1);
+		if (isVariable(L) && (!isVariable(R) || idOf(L) > idOf(R))) {
+			Var = L;
+			Def = R;
+			return true;
+		} else if (isVariable(R)) {
+			Var = R;
+			Def = L;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<size_t> SMTVarEliminator::dependencies(const z3::expr& E,
+		const std::unordered_map<unsigned, size_t>& Candidates) {
+	std::vector<size_t> Ret;
+	std::unordered_set<unsigned> Visited;
+	std::vector<Z3_ast> Worklist(1, E);
+	while (!Worklist.empty()) {
+		Z3_ast Node = Worklist.back();
+		Worklist.pop_back();
+		if (!Visited.insert(Z3_get_ast_id(Ctx, Node)).second || Z3_get_ast_kind(Ctx, Node) != Z3_APP_AST) {
+			continue;
+		}
+
+		Z3_app App = Z3_to_app(Ctx, Node);
+		unsigned NumArgs = Z3_get_app_num_args(Ctx, App);
+		if (NumArgs == 0) {
+			auto It = Candidates.find(Z3_get_ast_id(Ctx, Node));
+			if (It != Candidates.end()) {
+				Ret.push_back(It->second);
+			}
+		}
+		for (unsigned I = 0; I < NumArgs; I++) {
+			Worklist.push_back(Z3_get_app_arg(Ctx, App, I));
+		}
+	}
+	return Ret;
+}
+
+bool SMTVarEliminator::eliminate(const z3::expr_vector& Assertions) {
+	Vars.resize(0);
+	Defs.resize(0);
+	Reduced.resize(0);
+
+	// 1. the top-level conjuncts
+	std::vector<z3::expr> Conjuncts;
+	std::vector<z3::expr> Worklist;
+	for (int I = (int) Assertions.size() - 1; I >= 0; I--) {
+		Worklist.push_back(Assertions[I]);
+	}
+	while (!Worklist.empty()) {
+		z3::expr E = Worklist.back();
+		Worklist.pop_back();
+		if (isKind(E, Z3_OP_AND)) {
+			for (int I = (int) E.num_args() - 1; I >= 0; I--) {
+				Worklist.push_back(E.arg(I));
+			}
+		} else if (!E.is_true()) {
+			Conjuncts.push_back(E);
+		}
+	}
+
+	// 2. the candidate definitions, one per variable
+	struct Candidate {
+		z3::expr Var;
+		z3::expr Def;
+		size_t Conjunct;
+		std::vector<size_t> Deps;
+	};
+	std::vector<Candidate> Candidates;
+	std::unordered_map<unsigned, size_t> CandidateOf;
+	for (size_t I = 0; I < Conjuncts.size(); I++) {
+		z3::expr Var(Ctx), Def(Ctx);
+		if (solvedForm(Conjuncts[I], Var, Def) && !CandidateOf.count(idOf(Var))) {
+			CandidateOf[idOf(Var)] = Candidates.size();
+			Candidates.push_back(Candidate{Var, Def, I, std::vector<size_t>()});
+		}
+	}
+	if (Candidates.empty()) {
+		return false;
+	}
+	for (auto& C : Candidates) {
+		C.Deps = dependencies(C.Def, CandidateOf);
+	}
+
+	// 3. Order the candidates so that each one follows its dependencies.
+	// A candidate closing a cycle (including "x == x + 1") is dropped.
+	enum { S_Unvisited, S_OnStack, S_Kept, S_Dropped };
+	std::vector<int> State(Candidates.size(), S_Unvisited);
+	std::vector<size_t> Order;
+	for (size_t Root = 0; Root < Candidates.size(); Root++) {
+		if (State[Root] != S_Unvisited) {
+			continue;
+		}
+		// <candidate, the next dependency to visit>
+		std::vector<std::pair<size_t, size_t>> Stack(1, std::make_pair(Root, (size_t) 0));
+		State[Root] = S_OnStack;
+		while (!Stack.empty()) {
+			size_t C = Stack.back().first;
+			size_t& Next = Stack.back().second;
+			if (State[C] == S_OnStack && Next < Candidates[C].Deps.size()) {
+				size_t D = Candidates[C].Deps[Next++];
+				if (State[D] == S_OnStack) {
+					State[C] = S_Dropped;
+				} else if (State[D] == S_Unvisited) {
+					State[D] = S_OnStack;
+					Stack.push_back(std::make_pair(D, (size_t) 0));
+				}
+				continue;
+			}
+			if (State[C] == S_OnStack) {
+				State[C] = S_Kept;
+				Order.push_back(C);
+			}
+			Stack.pop_back();
+		}
+	}
+	if (Order.empty()) {
+		return false;
+	}
+
+	// 4. resolve the definitions, substituting only their own dependencies
+	std::vector<z3::expr> Resolved(Candidates.size(), Ctx.bool_val(true));
+	std::vector<bool> IsDefinition(Conjuncts.size(), false);
+	for (size_t C : Order) {
+		z3::expr_vector From(Ctx), To(Ctx);
+		for (size_t D : Candidates[C].Deps) {
+			if (State[D] == S_Kept) {
+				From.push_back(Candidates[D].Var);
+				To.push_back(Resolved[D]);
+			}
+		}
+		Resolved[C] = From.empty() ? Candidates[C].Def : Candidates[C].Def.substitute(From, To);
+		Vars.push_back(Candidates[C].Var);
+		Defs.push_back(Resolved[C]);
+		IsDefinition[Candidates[C].Conjunct] = true;
+	}
+	Stats.Eliminated += Order.size();
+
+	// The cached definitions are alive, so equal ids mean equal exprs.
+	DefinitionsChanged = Vars.size() != CachedVars.size();
+	for (unsigned I = 0; I < Vars.size() && !DefinitionsChanged; I++) {
+		DefinitionsChanged = idOf(Vars[I]) != idOf(CachedVars[I]) || idOf(Defs[I]) != idOf(CachedDefs[I]);
+	}
+	if (DefinitionsChanged) {
+		CachedVars = Vars;
+		CachedDefs = Defs;
+	}
+
+	// The cache also drops the popped assertions when it grows too large.
+	if (DefinitionsChanged || Cache.size() > 2 * Conjuncts.size() + 1024) {
+		Cache.clear();
+	}
+
+	// 5. Substitute the other conjuncts. The uncached ones are substituted
+	// by a single call, since each call builds a map of all definitions.
+	z3::expr_vector Uncached(Ctx);
+	for (size_t I = 0; I < Conjuncts.size(); I++) {
+		if (!IsDefinition[I] && !Cache.count(idOf(Conjuncts[I]))) {
+			Uncached.push_back(Conjuncts[I]);
+		}
+	}
+	if (!Uncached.empty()) {
+		Stats.Substituted += Uncached.size();
+		z3::expr Substituted = Uncached.size() == 1 ? Uncached[0].substitute(Vars, Defs)
+				: z3::mk_and(Uncached).substitute(Vars, Defs);
+		bool Split = Uncached.size() > 1 && isKind(Substituted, Z3_OP_AND) && Substituted.num_args() == Uncached.size();
+		for (unsigned I = 0; I < Uncached.size(); I++) {
+			z3::expr S = Substituted;
+			if (Split) {
+				S = Substituted.arg(I);
+			} else if (Uncached.size() > 1) {
+				// the conjunction is rewritten, so substitute one by one
+				S = Uncached[I].substitute(Vars, Defs);
+			}
+			Cache.insert(std::make_pair(idOf(Uncached[I]), std::make_pair(Uncached[I], S)));
+		}
+	}
+
+	for (size_t I = 0; I < Conjuncts.size(); I++) {
+		if (IsDefinition[I]) {
+			continue;
+		}
+		auto It = Cache.find(idOf(Conjuncts[I]));
+		if (It->second.second.is_true()) {
+			continue;
+		}
+		Reduced.push_back(It->second.second);
+	}
+	Stats.CacheHits += Conjuncts.size() - Order.size() - Uncached.size();
+	return true;
+}
+
+z3::solver SMTVarEliminator::getReducedSolver(const std::function<z3::solver()>& Create) {
+	if (!ReducedSolver || DefinitionsChanged) {
+		ReducedSolver.reset(new z3::solver(Create()));
+		InSolver.clear();
+		Batches.clear();
+	}
+
+	// The reduced conjuncts are in the order of the assertions, so the
+	// ones of the assertions kept since the last call are a prefix.
+	size_t Common = 0;
+	while (Common < InSolver.size() && Common < Reduced.size() && idOf(InSolver[Common]) == idOf(Reduced[Common])) {
+		Common++;
+	}
+	unsigned NumPops = 0;
+	while (InSolver.size() > Common) {
+		InSolver.resize(Batches.back(), Ctx.bool_val(true));
+		Batches.pop_back();
+		NumPops++;
+	}
+	if (NumPops) {
+		ReducedSolver->pop(NumPops);
+	}
+
+	if (InSolver.size() < Reduced.size()) {
+		ReducedSolver->push();
+		Batches.push_back(InSolver.size());
+		for (unsigned I = InSolver.size(); I < Reduced.size(); I++) {
+			ReducedSolver->add(Reduced[I]);
+			InSolver.push_back(Reduced[I]);
+		}
+	}
+	return *ReducedSolver;
+}
+
+void SMTVarEliminator::reconstruct(z3::model& M) {
+	for (unsigned I = 0; I < Vars.size(); I++) {
+		z3::func_decl Decl = Vars[I].decl();
+		z3::expr Value = M.eval(Defs[I], true);
+		M.add_const_interp(Decl, Value);
+	}
+}
@@ -0,0 +1,390 @@
+/*
+ * Regression tests of SMTSolver, run under several configurations of the
+ * solver options. It exits with a non-zero status if a test fails.
+ */
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "SMT/SMTFactory.h"
+#include "SMT/SMTModel.h"
+#include "SMT/SMTCheckFuture.h"
+#include "SMT/SMTUnsatCoreCache.h"
+#include "SMT/SMTLIBWriter.h"
+#include "SMT/SMTConfigure.h"
+
+using namespace llvm;
+
+struct Configuration {
+    const char* Name;
+    /// <option, value> pairs, as if given on the command line
+    std::vector<std::pair<const char*, const char*>> Options;
+};
+
+static const std::vector<Configuration> Configurations = {
+    { "default", {} },
+    { "simplify-local", { { "solver-simplify", "local" } } },
+    { "simplify-dillig", { { "solver-simplify", "dillig" } } },
+    { "sliced", { { "solver-independence-slicing", "true" } } },
+    { "unsat-core-cache", { { "solver-unsat-core-cache", "64" } } },
+    { "eliminate-vars", { { "solver-eliminate-vars", "true" } } },
+    { "route-by-logic", { { "solver-route-by-logic", "true" } } },
+    { "model-reuse", { { "solver-model-reuse", "8" } } },
+};
+
+static unsigned NumFailures = 0;
+
+static void configure(const Configuration& C) {
+    cl::ResetAllOptionOccurrences();
+    StringMap<cl::Option*>& Options = cl::getRegisteredOptions();
+    for (auto& O : C.Options) {
+        auto It = Options.find(O.first);
+        if (It == Options.end() || It->second->addOccurrence(0, O.first, O.second)) {
+            report_fatal_error(Twine("cannot set -") + O.first + "=" + O.second);
+        }
+    }
+    SMTConfig::init();
+}
+
+static void expect(const Configuration& C, const char* Test, SMTSolver::SMTResultType Result,
+        SMTSolver::SMTResultType Expected) {
+    if (Result != Expected) {
+        errs() << "FAIL " << C.Name << " " << Test << ": " << Result << ", expected " << Expected << "\n";
+        NumFailures++;
+    }
+}
+
+/// An assertion added before a push and not checked before it must
+/// survive the pop of that scope.
+static void testUncheckedBeforePush(const Configuration& C) {
+    SMTFactory F;
+    SMTSolver S = F.createSMTSolver();
+    SMTExpr X = F.createBitVecConst("x", 32);
+
+    S.add(X == F.createBitVecVal(1, 32));
+    S.push();
+    S.add(X == F.createBitVecVal(2, 32));
+    expect(C, "unchecked-before-push/inner", S.check(), SMTSolver::SMTRT_Unsat);
+    S.pop();
+    S.add(X == F.createBitVecVal(3, 32));
+    expect(C, "unchecked-before-push/outer", S.check(), SMTSolver::SMTRT_Unsat);
+}
+
+static void testDefinitionBeforePush(const Configuration& C) {
+    SMTFactory F;
+    SMTSolver S = F.createSMTSolver();
+    SMTExpr T = F.createBitVecConst("t", 32);
+    SMTExpr X = F.createBitVecConst("x", 32);
+    SMTExpr Y = F.createBitVecConst("y", 32);
+
+    S.add(T == X + Y);
+    S.add(X == F.createBitVecVal(1, 32));
+    S.push();
+    S.add(Y == F.createBitVecVal(2, 32));
+    expect(C, "definition-before-push/inner", S.check(), SMTSolver::SMTRT_Sat);
+    S.pop();
+    S.add(T == F.createBitVecVal(5, 32));
+    S.add(Y != F.createBitVecVal(4, 32));
+    expect(C, "definition-before-push/outer", S.check(), SMTSolver::SMTRT_Unsat);
+}
+
+/// Checks between pushes and pops, under the same definitions of the
+/// variables (see -solver-eliminate-vars).
+static void testSameDefinitions(const Configuration& C) {
+    SMTFactory F;
+    SMTSolver S = F.createSMTSolver();
+    SMTExpr A = F.createBitVecConst("a", 32);
+    SMTExpr B = F.createBitVecConst("b", 32);
+    SMTExpr X = F.createBitVecConst("c", 32);
+    SMTExpr Four = F.createBitVecVal(4, 32);
+    SMTExpr Five = F.createBitVecVal(5, 32);
+
+    S.add(A == B + F.createBitVecVal(1, 32));
+    S.add(B == F.createBitVecVal(2, 32));
+    S.push();
+    S.add(X.basic_ugt(A));
+    expect(C, "same-definitions/first", S.check(), SMTSolver::SMTRT_Sat);
+    S.add(X.basic_ult(Four));
+    expect(C, "same-definitions/added", S.check(), SMTSolver::SMTRT_Unsat);
+    S.pop();
+    S.add(X.basic_ult(Five));
+    expect(C, "same-definitions/popped", S.check(), SMTSolver::SMTRT_Sat);
+    S.push();
+    S.add(X.basic_ult(A));
+    S.add(X.basic_ugt(A));
+    expect(C, "same-definitions/pushed", S.check(), SMTSolver::SMTRT_Unsat);
+    S.pop();
+    expect(C, "same-definitions/last", S.check(), SMTSolver::SMTRT_Sat);
+}
+
+/// The model of a query of independent components (see
+/// -solver-independence-slicing) assigns the variables of all of them,
+/// whether a component is solved or answered by a cache.
+static void testModelOfComponents(const Configuration& C) {
+    SMTFactory F;
+    SMTExpr X = F.createBitVecConst("x", 32);
+    SMTExpr Y = F.createBitVecConst("y", 32);
+    SMTExpr Z = F.createBitVecConst("z", 32);
+
+    for (int Round = 0; Round < 2; Round++) {
+        SMTSolver S = F.createSMTSolver();
+        S.add(X == F.createBitVecVal(1, 32));
+        S.add(Y == F.createBitVecVal(2, 32));
+        S.add(Z == F.createBitVecVal(3 + Round, 32));
+        expect(C, "model-of-components/check", S.check(), SMTSolver::SMTRT_Sat);
+
+        std::vector<uint64_t> Values;
+        S.getSMTModel().evalUint64(F.createSMTExprVec({ X, Y, Z }), Values);
+        if (Values != std::vector<uint64_t>({ 1, 2, (uint64_t) 3 + Round })) {
+            errs() << "FAIL " << C.Name << " model-of-components/model\n";
+            NumFailures++;
+        }
+    }
+}
+
+/// A model reused from the pool (see -solver-model-reuse) does not change
+/// when the pool answers later queries.
+static void testReusedModels(const Configuration& C) {
+    SMTFactory F;
+    SMTExpr X = F.createBitVecConst("x", 32);
+    SMTExpr Y = F.createBitVecConst("y", 32);
+    SMTExpr Z = F.createBitVecConst("z", 32);
+    SMTExpr One = F.createBitVecVal(1, 32);
+
+    SMTSolver S1 = F.createSMTSolver();
+    S1.add(X == One);
+    expect(C, "reused-models/first", S1.check(), SMTSolver::SMTRT_Sat);
+
+    SMTSolver S2 = F.createSMTSolver();
+    S2.add(X == One);
+    S2.add(Y != One);
+    expect(C, "reused-models/second", S2.check(), SMTSolver::SMTRT_Sat);
+    SMTModel M2 = S2.getSMTModel();
+    size_t Before = M2.getConstants().size();
+
+    SMTSolver S3 = F.createSMTSolver();
+    S3.add(X == One);
+    S3.add(Z != One);
+    expect(C, "reused-models/third", S3.check(), SMTSolver::SMTRT_Sat);
+    if (M2.getConstants().size() != Before) {
+        errs() << "FAIL " << C.Name << " reused-models/changed\n";
+        NumFailures++;
+    }
+}
+
+/// The model of a query solved with tracking literals for its unsat
+/// core (see -solver-unsat-core-cache) does not interpret the literals.
+static void testCoresAndModels(const Configuration& C) {
+    SMTFactory F;
+    SMTExpr X = F.createBitVecConst("x", 32);
+    SMTExpr Y = F.createBitVecConst("y", 32);
+    SMTExpr Z = F.createBitVecConst("z", 32);
+
+    SMTSolver S1 = F.createSMTSolver();
+    S1.add(X == F.createBitVecVal(1, 32));
+    S1.add(Y == F.createBitVecVal(2, 32));
+    S1.add(X == F.createBitVecVal(2, 32));
+    expect(C, "cores-and-models/unsat", S1.check(), SMTSolver::SMTRT_Unsat);
+
+    SMTSolver S2 = F.createSMTSolver();
+    S2.add(X == F.createBitVecVal(1, 32));
+    S2.add(Z == F.createBitVecVal(3, 32));
+    S2.add(X == F.createBitVecVal(2, 32));
+    expect(C, "cores-and-models/core", S2.check(), SMTSolver::SMTRT_Unsat);
+
+    SMTSolver S3 = F.createSMTSolver();
+    S3.add(X == F.createBitVecVal(1, 32));
+    S3.add(Y == F.createBitVecVal(2, 32));
+    expect(C, "cores-and-models/sat", S3.check(), SMTSolver::SMTRT_Sat);
+    if (S3.getSMTModel().getConstants().size() != 2) {
+        errs() << "FAIL " << C.Name << " cores-and-models/model\n";
+        NumFailures++;
+    }
+}
+
+/// The unsat core of a query of a tactic solver (which answers unsat
+/// under assumptions with an empty core) is recorded all the same.
+static void testCoreOfTacticSolver(const Configuration& C) {
+    SMTFactory F;
+    SMTSolver S = F.createSMTSolverWithTactic("qfbv");
+    SMTExpr X = F.createBitVecConst("x", 32);
+    SMTExpr Y = F.createBitVecConst("y", 32);
+
+    S.add(X == F.createBitVecVal(1, 32));
+    S.add(Y == F.createBitVecVal(2, 32));
+    S.add(X == F.createBitVecVal(2, 32));
+    expect(C, "core-of-tactic-solver/check", S.check(), SMTSolver::SMTRT_Unsat);
+    if (F.getUnsatCoreCache().enabled() && F.getUnsatCoreCache().size() != 1) {
+        errs() << "FAIL " << C.Name << " core-of-tactic-solver/recorded\n";
+        NumFailures++;
+    }
+}
+
+/// A core replaces the recorded cores it is a prefix of (in the order of
+/// the AST ids), which are no longer counted.
+static void testUnsatCoreCache() {
+    z3::context Ctx;
+    z3::expr A = Ctx.bool_const("a");
+    z3::expr B = Ctx.bool_const("b");
+    z3::expr D = Ctx.bool_const("d");
+    auto Vector = [&Ctx](std::initializer_list<z3::expr> Exprs) {
+        z3::expr_vector Ret(Ctx);
+        for (auto& E : Exprs) {
+            Ret.push_back(E);
+        }
+        return Ret;
+    };
+
+    SMTUnsatCoreCache Cache(4);
+    Cache.insert(Vector({ A, B, D }));
+    Cache.insert(Vector({ A, B }));
+    Cache.insert(Vector({ A }));
+    if (Cache.size() != 1 || !Cache.containsCoreOf(Vector({ A, D }))
+            || Cache.containsCoreOf(Vector({ B, D }))) {
+        errs() << "FAIL unsat-core-cache/supersets: " << Cache.size() << " cores\n";
+        NumFailures++;
+    }
+}
+
+/// The symbols whose names need quoting, including those with '|' or a
+/// backslash, are written so that the query is parsed back.
+static void testSymbolQuoting() {
+    z3::context Ctx;
+    z3::expr A = Ctx.bv_const("a|b", 8);
+    z3::expr B = Ctx.bv_const("c\\d", 8);
+    z3::expr D = Ctx.bv_const("x y", 8);
+    z3::expr_vector Assertions(Ctx);
+    Assertions.push_back(A == B + D);
+    Assertions.push_back(A != B);
+
+    std::string Query;
+    {
+        SMTLIBWriter Writer(Query);
+        Writer.addAll(Assertions);
+    }
+    try {
+        z3::solver Parsed(Ctx);
+        Parsed.from_string(Query.c_str());
+        if (Parsed.assertions().size() != 2 || Parsed.check() != z3::check_result::sat) {
+            errs() << "FAIL smtlib-writer/quoting: " << Query;
+            NumFailures++;
+        }
+    } catch (z3::exception& Ex) {
+        errs() << "FAIL smtlib-writer/quoting: " << Ex.msg() << "\n" << Query;
+        NumFailures++;
+    }
+}
+
+/// The guards of checkAssuming() are not assertions of the solver, and
+/// their indicator literals are not in its models.
+static void testAssumptionGuards(const Configuration& C) {
+    SMTFactory F;
+    SMTSolver S = F.createSMTSolver();
+    SMTExpr X = F.createBitVecConst("x", 32);
+    SMTExpr Y = F.createBitVecConst("y", 32);
+
+    S.add(X == F.createBitVecVal(1, 32));
+    SMTExprVec Assumed = F.createSMTExprVec({ Y == F.createBitVecVal(2, 32) });
+    expect(C, "assumption-guards/assuming", S.checkAssuming(Assumed), SMTSolver::SMTRT_Sat);
+    expect(C, "assumption-guards/check", S.check(), SMTSolver::SMTRT_Sat);
+
+    bool Leaked = S.assertions().size() != 1;
+    SMTExprVec Constants = S.getSMTModel().getConstants();
+    for (unsigned I = 0; I < Constants.size(); I++) {
+        Leaked = Leaked || Constants[I].getSymbol().find("assume") == 0;
+    }
+    if (Leaked) {
+        errs() << "FAIL " << C.Name << " assumption-guards/leaked\n";
+        NumFailures++;
+    }
+}
+
+/// The assumptions of checkAssuming() do not widen the fragment (i.e. the
+/// logic) of the later checks.
+static void testAssumptionFragments(const Configuration& C) {
+    SMTFactory F;
+    SMTSolver S = F.createSMTSolver();
+    SMTExpr X = F.createBitVecConst("x", 32);
+    SMTExpr R = F.createRealConst("r");
+
+    S.add(X == F.createBitVecVal(1, 32));
+    SMTExprVec Assumed = F.createSMTExprVec({ R == F.createRealVal("1") });
+    expect(C, "assumption-fragments/assuming", S.checkAssuming(Assumed), SMTSolver::SMTRT_Sat);
+    expect(C, "assumption-fragments/check", S.check(), SMTSolver::SMTRT_Sat);
+
+    for (auto& It : F.getFragmentStatistics().get()) {
+        if (It.first != "bv") {
+            errs() << "FAIL " << C.Name << " assumption-fragments/fragment: " << It.first << "\n";
+            NumFailures++;
+        }
+    }
+}
+
+/// Cancelling a check that waits for the FactoryLock must not interrupt
+/// the checks of the lock holder on the same context.
+static void testCancelBeforeStart(const Configuration& C) {
+    SMTFactory F;
+    SMTSolver Waiting = F.createSMTSolver();
+    SMTSolver Holder = F.createSMTSolver();
+    SMTExpr X = F.createBitVecConst("x", 32);
+    SMTExpr Y = F.createBitVecConst("y", 32);
+    SMTExpr One = F.createBitVecVal(1, 32);
+
+    std::unique_lock<std::mutex> L(F.getFactoryLock());
+    Waiting.add(X == One);
+    SMTCheckFuture Future = Waiting.checkAsync();
+    std::thread Canceller([&Future]() { Future.cancel(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // a factorization, which takes z3 a while
+    SMTExpr Bound = F.createBitVecVal(1 << 20, 32);
+    Holder.add(X * Y == F.createBitVecVal(1000003ull * 997, 32));
+    Holder.add(One.basic_ult(X));
+    Holder.add(One.basic_ult(Y));
+    Holder.add(X.basic_ult(Bound));
+    Holder.add(Y.basic_ult(Bound));
+    expect(C, "cancel-before-start/holder", Holder.check(), SMTSolver::SMTRT_Sat);
+    L.unlock();
+
+    Canceller.join();
+    if (!Future.cancelled()) {
+        errs() << "FAIL " << C.Name << " cancel-before-start/cancelled\n";
+        NumFailures++;
+    }
+    expect(C, "cancel-before-start/waiting", Future.get(), SMTSolver::SMTRT_Unknown);
+}
+
+int main(int argc, char** argv) {
+    cl::ParseCommandLineOptions(argc, argv, "Regression tests of SMTSolver\n");
+
+    for (auto& C : Configurations) {
+        configure(C);
+        testUncheckedBeforePush(C);
+        testDefinitionBeforePush(C);
+        testSameDefinitions(C);
+        testModelOfComponents(C);
+        testReusedModels(C);
+        testCoresAndModels(C);
+        testCoreOfTacticSolver(C);
+        testAssumptionGuards(C);
+        testAssumptionFragments(C);
+        testCancelBeforeStart(C);
+    }
+
+    testUnsatCoreCache();
+    testSymbolQuoting();
+
+    if (NumFailures) {
+        errs() << NumFailures << " test(s) failed\n";
+        return 1;
+    }
+    outs() << "All tests passed\n";
+    return 0;
+}